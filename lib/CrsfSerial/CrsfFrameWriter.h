@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "crsf_protocol.h"
+
+// Owner of the buffer a CrsfFrameWriter builds a frame in
+class CrsfFrameSink
+{
+public:
+    virtual ~CrsfFrameSink() {}
+    // The frame's payload is complete, len bytes after Sync + Len + Type
+    virtual bool commitFrame(const uint8_t *frame, uint8_t len) = 0;
+};
+
+/**
+ * Builds an outgoing frame directly in a CrsfSerial transmit slot, get one
+ * from CrsfSerial::reservePacket(). Payload values are appended in order,
+ * big endian as CRSF sensors expect. commit() fills in the length and crc
+ * and queues the frame, a writer which is never committed is discarded.
+ * Only one frame can be reserved at a time
+ */
+class CrsfFrameWriter
+{
+public:
+    CrsfFrameWriter(CrsfFrameSink *sink, uint8_t *frame) : _sink(sink), _frame(frame), _len(0) {}
+
+    // False if there was no free slot or the payload overflowed, writes are then ignored
+    bool isValid() const { return _frame != nullptr; }
+    uint8_t payloadLen() const { return _len; }
+
+    CrsfFrameWriter &u8(uint8_t val)
+    {
+        uint8_t *p = reserve(1);
+        if (p)
+            p[0] = val;
+        return *this;
+    }
+    CrsfFrameWriter &u16(uint16_t val)
+    {
+        uint8_t *p = reserve(2);
+        if (p)
+        {
+            p[0] = val >> 8;
+            p[1] = val;
+        }
+        return *this;
+    }
+    CrsfFrameWriter &u24(uint32_t val)
+    {
+        uint8_t *p = reserve(3);
+        if (p)
+        {
+            p[0] = val >> 16;
+            p[1] = val >> 8;
+            p[2] = val;
+        }
+        return *this;
+    }
+    CrsfFrameWriter &u32(uint32_t val)
+    {
+        uint8_t *p = reserve(4);
+        if (p)
+        {
+            p[0] = val >> 24;
+            p[1] = val >> 16;
+            p[2] = val >> 8;
+            p[3] = val;
+        }
+        return *this;
+    }
+    CrsfFrameWriter &i16(int16_t val) { return u16(val); }
+    CrsfFrameWriter &i24(int32_t val) { return u24(val); }
+    CrsfFrameWriter &bytes(const void *buf, uint8_t len)
+    {
+        uint8_t *p = reserve(len);
+        if (p)
+            memcpy(p, buf, len);
+        return *this;
+    }
+
+    // Finish the frame and queue it for sending, returns false if it was dropped
+    bool commit()
+    {
+        if (_frame == nullptr)
+            return false;
+        bool retVal = _sink->commitFrame(_frame, _len);
+        _frame = nullptr;
+        return retVal;
+    }
+
+private:
+    CrsfFrameSink *_sink;
+    uint8_t *_frame;
+    uint8_t _len;
+
+    uint8_t *reserve(uint8_t len)
+    {
+        if (_frame == nullptr)
+            return nullptr;
+        if (_len + len > CRSF_MAX_PAYLOAD_LEN)
+        {
+            _frame = nullptr;
+            return nullptr;
+        }
+        // Payload starts after Sync + Len + Type
+        uint8_t *p = &_frame[3 + _len];
+        _len += len;
+        return p;
+    }
+};
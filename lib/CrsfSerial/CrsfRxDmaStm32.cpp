@@ -0,0 +1,108 @@
+#include "CrsfRxDmaStm32.h"
+
+#if defined(ARDUINO_ARCH_STM32) && defined(STM32F1xx) && defined(USE_CRSF_DMA)
+
+CrsfRxDmaStm32::CrsfRxDmaStm32(USART_TypeDef *usart) :
+    onRxEvent(nullptr), _usart(usart), _readPos(0), _readTotal(0), _halves(0), _overruns(0)
+{
+    // Fixed DMA1 request mapping for USARTx_RX on STM32F1
+    if (usart == USART1)
+    {
+        _dma = DMA1_Channel5;
+        _irq = DMA1_Channel5_IRQn;
+        _channel = 5;
+    }
+    else if (usart == USART2)
+    {
+        _dma = DMA1_Channel6;
+        _irq = DMA1_Channel6_IRQn;
+        _channel = 6;
+    }
+    else
+    {
+        _dma = DMA1_Channel3;
+        _irq = DMA1_Channel3_IRQn;
+        _channel = 3;
+    }
+}
+
+void CrsfRxDmaStm32::begin()
+{
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    _dma->CCR = 0;
+    _dma->CPAR = (uint32_t)&_usart->DR;
+    _dma->CMAR = (uint32_t)_buf;
+    _dma->CNDTR = RX_BUF_SIZE;
+    _dma->CCR = DMA_CCR_PL_1 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE;
+    DMA1->IFCR = DMA_IFCR_CGIF1 << ((_channel - 1) * 4);
+    _readPos = 0;
+    _readTotal = 0;
+    _halves = 0;
+
+    // HardwareSerial::begin() started interrupt driven receive, stop the
+    // per-byte RXNE interrupt and the error interrupts (the HAL's error
+    // handling would turn DMAR back off) and let the DMA take the bytes
+    CLEAR_BIT(_usart->CR1, USART_CR1_RXNEIE | USART_CR1_PEIE);
+    CLEAR_BIT(_usart->CR3, USART_CR3_EIE);
+    SET_BIT(_usart->CR3, USART_CR3_DMAR);
+
+    HAL_NVIC_SetPriority(_irq, UART_IRQ_PRIO, UART_IRQ_SUBPRIO);
+    HAL_NVIC_EnableIRQ(_irq);
+    _dma->CCR |= DMA_CCR_EN;
+}
+
+size_t CrsfRxDmaStm32::peek(const uint8_t **buf)
+{
+    // CNDTR counts down from RX_BUF_SIZE and reloads when the buffer wraps.
+    // Read the event count first, if the DMA has since moved into the other
+    // half its interrupt has not been counted yet
+    uint32_t halves = _halves;
+    size_t writePos = (RX_BUF_SIZE - _dma->CNDTR) % RX_BUF_SIZE;
+    if ((writePos / RX_HALF_SIZE) != (halves % 2))
+        ++halves;
+
+    // Once the DMA is a whole buffer ahead it has overwritten unread data
+    uint32_t writeTotal = halves * RX_HALF_SIZE + (writePos % RX_HALF_SIZE);
+    if (writeTotal - _readTotal >= RX_BUF_SIZE)
+    {
+        ++_overruns;
+        _readPos = writePos;
+        _readTotal = writeTotal;
+    }
+
+    *buf = &_buf[_readPos];
+    if (writePos >= _readPos)
+        return writePos - _readPos;
+    // Data wraps the end of the buffer, return up to the end this time
+    return RX_BUF_SIZE - _readPos;
+}
+
+void CrsfRxDmaStm32::consume(size_t len)
+{
+    _readPos = (_readPos + len) % RX_BUF_SIZE;
+    _readTotal += len;
+}
+
+uint32_t CrsfRxDmaStm32::takeOverruns()
+{
+    uint32_t retVal = _overruns;
+    _overruns = 0;
+    return retVal;
+}
+
+void CrsfRxDmaStm32::handleIrq()
+{
+    // Only clear the events counted, one arriving in between stays pending
+    unsigned int shift = (_channel - 1) * 4;
+    uint32_t events = (DMA1->ISR >> shift) & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1);
+    if (events & DMA_ISR_HTIF1)
+        ++_halves;
+    if (events & DMA_ISR_TCIF1)
+        ++_halves;
+    DMA1->IFCR = events << shift;
+    if (onRxEvent)
+        onRxEvent();
+}
+
+#endif
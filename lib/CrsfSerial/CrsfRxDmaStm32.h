@@ -0,0 +1,46 @@
+#pragma once
+
+#if defined(ARDUINO_ARCH_STM32) && defined(STM32F1xx) && defined(USE_CRSF_DMA)
+
+#include <Arduino.h>
+#include "CrsfRxTransport.h"
+
+/**
+ * Receives a USART into a circular buffer using DMA1, so the CPU is not
+ * interrupted for every byte. Only the half and full transfer events
+ * generate an interrupt, which can be hooked with onRxEvent. Counting them
+ * tells how far the DMA has written in total, so if it has lapped the
+ * read position the buffer is dropped and counted as an overrun.
+ * The application defines the IRQ handler of the USART's DMA channel
+ * (USART1=5, USART2=6, USART3=3) and calls handleIrq() from it
+ */
+class CrsfRxDmaStm32 : public CrsfRxTransport
+{
+public:
+    // At 420000 baud this is about 6ms of data between calls to CrsfSerial::loop()
+    static const size_t RX_BUF_SIZE = 256;
+    static const size_t RX_HALF_SIZE = RX_BUF_SIZE / 2;
+
+    CrsfRxDmaStm32(USART_TypeDef *usart);
+    void begin() override;
+    size_t peek(const uint8_t **buf) override;
+    void consume(size_t len) override;
+    uint32_t takeOverruns() override;
+    void handleIrq();
+
+    // Called from the DMA interrupt when the buffer is half or completely filled
+    void (*onRxEvent)();
+
+private:
+    USART_TypeDef *_usart;
+    DMA_Channel_TypeDef *_dma;
+    IRQn_Type _irq;
+    uint8_t _channel;
+    size_t _readPos;
+    uint32_t _readTotal;        // bytes consumed since begin()
+    volatile uint32_t _halves;  // half and full transfer events since begin()
+    uint32_t _overruns;
+    uint8_t _buf[RX_BUF_SIZE];
+};
+
+#endif
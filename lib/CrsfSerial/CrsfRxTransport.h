@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A source of received CRSF bytes which can hand over blocks of data in place,
+ * used instead of reading the HardwareSerial one byte at a time.
+ * Attach to CrsfSerial with setRxTransport()
+ */
+class CrsfRxTransport
+{
+public:
+    virtual ~CrsfRxTransport() {}
+    // Called after the CrsfSerial port has been (re)opened
+    virtual void begin() = 0;
+    // Point buf at the next contiguous block of received data, return its length or 0 if none
+    virtual size_t peek(const uint8_t **buf) = 0;
+    // Release len bytes of the block returned by peek()
+    virtual void consume(size_t len) = 0;
+    // Times received data was lost because it was not read in time, since the last call
+    virtual uint32_t takeOverruns() { return 0; }
+};
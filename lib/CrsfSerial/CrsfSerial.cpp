@@ -1,345 +1,934 @@
-#include "CrsfSerial.h"
-
-// static void hexdump(void *p, size_t len)
-// {
-//     char *data = (char *)p;
-//     while (len > 0)
-//     {
-//         uint8_t linepos = 0;
-//         char* linestart = data;
-//         // Binary part
-//         while (len > 0 && linepos < 16)
-//         {
-//             if (*data < 0x0f)
-//             Serial.write('0');
-//             Serial.print(*data, HEX);
-//             Serial.write(' ');
-//             ++data;
-//             ++linepos;
-//             --len;
-//         }
-
-//         // Spacer to align last line
-//         for (uint8_t i = linepos; i < 16; ++i)
-//             Serial.print("   ");
-
-//         // ASCII part
-//         for (uint8_t i = 0; i < linepos; ++i)
-//             Serial.write((linestart[i] < ' ') ? '.' : linestart[i]);
-//         Serial.println();
-//     }
-// }
-
-CrsfSerial::CrsfSerial(HardwareSerial &port, uint32_t baud) :
-    _port(port), _crc(0xd5), _baud(baud),
-    _lastReceive(0), _lastChannelsPacket(0), _linkIsUp(false),
-    _passthroughBaud(0)
-{}
-
-void CrsfSerial::begin(uint32_t baud)
-{
-    if (baud != 0)
-        _port.begin(baud);
-    else
-        _port.begin(_baud);
-}
-
-// Call from main loop to update
-void CrsfSerial::loop()
-{
-    handleSerialIn();
-}
-
-void CrsfSerial::handleSerialIn()
-{
-    while (_port.available())
-    {
-        uint8_t b = _port.read();
-        _lastReceive = millis();
-
-        if (getPassthroughMode())
-        {
-            if (onOobData)
-                onOobData(b);
-            continue;
-        }
-
-        _rxBuf[_rxBufPos++] = b;
-        handleByteReceived();
-
-        if (_rxBufPos == (sizeof(_rxBuf)/sizeof(_rxBuf[0])))
-        {
-            // Packet buffer filled and no valid packet found, dump the whole thing
-            _rxBufPos = 0;
-        }
-    }
-
-    checkPacketTimeout();
-    checkLinkDown();
-}
-
-void CrsfSerial::handleByteReceived()
-{
-    bool reprocess;
-    do
-    {
-        reprocess = false;
-        if (_rxBufPos > 1)
-        {
-            uint8_t len = _rxBuf[1];
-            // Sanity check the declared length isn't outside Type + X{1,CRSF_MAX_PAYLOAD_LEN} + CRC
-            // assumes there never will be a CRSF message that just has a type and no data (X)
-            if (len < 3 || len > (CRSF_MAX_PAYLOAD_LEN + 2))
-            {
-                shiftRxBuffer(1);
-                reprocess = true;
-            }
-
-            else if (_rxBufPos >= (len + 2))
-            {
-                uint8_t inCrc = _rxBuf[2 + len - 1];
-                uint8_t crc = _crc.calc(&_rxBuf[2], len - 1);
-                if (crc == inCrc)
-                {
-                    processPacketIn(len);
-                    shiftRxBuffer(len + 2);
-                    reprocess = true;
-                }
-                else
-                {
-                    shiftRxBuffer(1);
-                    reprocess = true;
-                }
-            }  // if complete packet
-        } // if pos > 1
-    } while (reprocess);
-}
-
-void CrsfSerial::checkPacketTimeout()
-{
-    // If we haven't received data in a long time, flush the buffer a byte at a time (to trigger shiftyByte)
-    if (_rxBufPos > 0 && millis() - _lastReceive > CRSF_PACKET_TIMEOUT_MS)
-        while (_rxBufPos)
-            shiftRxBuffer(1);
-}
-
-void CrsfSerial::checkLinkDown()
-{
-    if (_linkIsUp && millis() - _lastChannelsPacket > CRSF_FAILSAFE_STAGE1_MS)
-    {
-        if (onLinkDown)
-            onLinkDown();
-        _linkIsUp = false;
-    }
-}
-
-void CrsfSerial::processPacketIn(uint8_t len)
-{
-    const crsf_header_t *hdr = (crsf_header_t *)_rxBuf;
-    switch (hdr->type)
-    {
-    case CRSF_FRAMETYPE_GPS:
-        packetGps(hdr);
-        break;
-    case CRSF_FRAMETYPE_RC_CHANNELS_PACKED:
-        packetChannelsPacked(hdr);
-        break;
-    case CRSF_FRAMETYPE_LINK_STATISTICS:
-        packetLinkStatistics(hdr);
-        break;
-    }
-}
-
-// Shift the bytes in the RxBuf down by cnt bytes
-void CrsfSerial::shiftRxBuffer(uint8_t cnt)
-{
-    // If removing the whole thing, just set pos to 0
-    if (cnt >= _rxBufPos)
-    {
-        _rxBufPos = 0;
-        return;
-    }
-
-    if (cnt == 1 && onOobData)
-        onOobData(_rxBuf[0]);
-
-    // Otherwise do the slow shift down
-    uint8_t *src = &_rxBuf[cnt];
-    uint8_t *dst = &_rxBuf[0];
-    _rxBufPos -= cnt;
-    uint8_t left = _rxBufPos;
-    while (left--)
-        *dst++ = *src++;
-}
-
-void CrsfSerial::packetChannelsPacked(const crsf_header_t *p)
-{
-    // Unpack CRSF channel data stored bytewise 11 bits / channel
-    // Code assumes there is enough payload for all the channels
-    constexpr unsigned inputMask = (1 << CRSF_BITS_PER_CHANNEL) - 1;
-    const uint8_t *buf = p->data;
-    unsigned scratch = 0; 
-    unsigned bitsInScratch = 0;
-    for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
-    {
-        while (bitsInScratch < CRSF_BITS_PER_CHANNEL)
-        {
-            scratch |= (*buf++) << bitsInScratch;
-            bitsInScratch += 8;
-        }
-
-        _channels[ch] = CRSF_to_US(scratch & inputMask);
-        scratch >>= CRSF_BITS_PER_CHANNEL;
-        bitsInScratch -= CRSF_BITS_PER_CHANNEL;
-    }
-
-    if (!_linkIsUp && onLinkUp)
-        onLinkUp();
-    _linkIsUp = true;
-    _lastChannelsPacket = millis();
-
-    if (onPacketChannels)
-        onPacketChannels();
-}
-
-void CrsfSerial::packetLinkStatistics(const crsf_header_t *p)
-{
-    const crsfLinkStatistics_t *link = (crsfLinkStatistics_t *)p->data;
-    memcpy(&_linkStatistics, link, sizeof(_linkStatistics));
-
-    // This is for the TX, but checkLinkDown() will keep triggering
-    // due to no channels coming in, so this is disabled for now
-    // because the timeout needs to be a function of packet rate
-    // bool linkIsUp = _linkStatistics.uplink_Link_quality != 0;
-    // if (linkIsUp != _linkIsUp)
-    // {
-    //     _linkIsUp = linkIsUp;
-    //     if (_linkIsUp && onLinkUp)
-    //         onLinkUp();
-    //     else if (!_linkIsUp && onLinkDown)
-    //         onLinkDown();
-    // }
-
-    if (onPacketLinkStatistics)
-        onPacketLinkStatistics(&_linkStatistics);
-}
-
-void CrsfSerial::packetGps(const crsf_header_t *p)
-{
-    const crsf_sensor_gps_t *gps = (crsf_sensor_gps_t *)p->data;
-    _gpsSensor.latitude = be32toh(gps->latitude);
-    _gpsSensor.longitude = be32toh(gps->longitude);
-    _gpsSensor.groundspeed = be16toh(gps->groundspeed);
-    _gpsSensor.heading = be16toh(gps->heading);
-    _gpsSensor.altitude = be16toh(gps->altitude);
-    _gpsSensor.satellites = gps->satellites;
-
-    if (onPacketGps)
-        onPacketGps(&_gpsSensor);
-}
-
-void CrsfSerial::write(uint8_t b)
-{
-    _port.write(b);
-}
-
-void CrsfSerial::write(const uint8_t *buf, size_t len)
-{
-    _port.write(buf, len);
-}
-
-void CrsfSerial::queuePacket(uint8_t type, const void *payload, uint8_t len)
-{
-    if (getPassthroughMode())
-        return;
-    if (len > CRSF_MAX_PAYLOAD_LEN)
-        return;
-
-    uint8_t buf[CRSF_MAX_PACKET_SIZE];
-    buf[0] = CRSF_SYNC_BYTE;
-    buf[1] = len + 2; // type + payload + crc
-    buf[2] = type;
-    memcpy(&buf[3], payload, len);
-    buf[len+3] = _crc.calc(&buf[2], len + 1);
-
-    write(buf, len + 4);
-}
-
-/***
- * @brief: Write 16 channels out as a handset would
- * @details:    TX ONLY! Packs the us channel data which has been set with setChannel()
- *              and writes it to the connected CRSF transmitter module.
- *              External CRSF transmitters are usually half duplex inverted
- *              and also scheduled by the module sending timing data, this
- *              code handles none of that. This will, however, get a
- *              transmitter to start transmitting channels.
- */
-void CrsfSerial::queuePacketChannels()
-{
-   // 11 bits per channel * 16 channels = 176 bits = 22 bytes
-    uint8_t packedChannels[(CRSF_NUM_CHANNELS * CRSF_BITS_PER_CHANNEL + 7) / 8];
-    uint8_t *pbuf = packedChannels;
-
-    // Pack 11 bit channels low byte first into packedChannels
-    uint32_t scratch = 0;
-    uint32_t bitsInScratch = 0;
-    for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
-    {
-        uint32_t crsfVal = US_to_CRSF(_channels[ch]);
-        scratch |= crsfVal << bitsInScratch;
-        bitsInScratch += CRSF_BITS_PER_CHANNEL;
-        while (bitsInScratch > 8)
-        {
-            *pbuf++ = scratch;
-            scratch >>= 8;
-            bitsInScratch -= 8;
-        }
-    }
-
-    queuePacket(CRSF_FRAMETYPE_RC_CHANNELS_PACKED, packedChannels, sizeof(packedChannels));
-}
-
-/**
- * @brief   Enter passthrough mode (serial sent directly to shiftybyte),
- *          optionally changing the baud rate used during passthrough mode
- * @param val
- *          True to start passthrough mode, false to resume processing CRSF
- * @param passthroughBaud
- *          New baud rate for passthrough mode, or 0 to not change baud
- *          Not used if disabling passthough
-*/
-void CrsfSerial::setPassthroughMode(bool val, uint32_t passthroughBaud)
-{
-    if (val)
-    {
-        // If not requesting any baud change
-        if (passthroughBaud == 0)
-        {
-            // Enter passthrough mode if not yet
-            if (_passthroughBaud == 0)
-                _passthroughBaud = _baud;
-            return;
-        }
-
-        _passthroughBaud = passthroughBaud;
-    }
-    else
-    {
-        // Not in passthrough, can't leave it any harder than we already are
-        if (_passthroughBaud == 0)
-            return;
-
-        // Leaving passthrough, but going back to same baud, just disable
-        if (_passthroughBaud == _baud)
-        {
-            _passthroughBaud = 0;
-            return;
-        }
-
-        _passthroughBaud = 0;
-    }
-
-    // Can only get here if baud is changing, close and reopen the port
-    _port.end(); // assumes flush()
-    begin(_passthroughBaud);
-}
+#include "CrsfSerial.h"
+
+// static void hexdump(void *p, size_t len)
+// {
+//     char *data = (char *)p;
+//     while (len > 0)
+//     {
+//         uint8_t linepos = 0;
+//         char* linestart = data;
+//         // Binary part
+//         while (len > 0 && linepos < 16)
+//         {
+//             if (*data < 0x0f)
+//             Serial.write('0');
+//             Serial.print(*data, HEX);
+//             Serial.write(' ');
+//             ++data;
+//             ++linepos;
+//             --len;
+//         }
+
+//         // Spacer to align last line
+//         for (uint8_t i = linepos; i < 16; ++i)
+//             Serial.print("   ");
+
+//         // ASCII part
+//         for (uint8_t i = 0; i < linepos; ++i)
+//             Serial.write((linestart[i] < ' ') ? '.' : linestart[i]);
+//         Serial.println();
+//     }
+// }
+
+CrsfSerial::CrsfSerial(HardwareSerial &port, uint32_t baud) :
+    onLinkUp(nullptr), onLinkDown(nullptr), onOobData(nullptr),
+    onPacketChannels(nullptr), onPacketLinkStatistics(nullptr), onPacketGps(nullptr),
+    _port(port), _rxTransport(nullptr), _telemetry(nullptr),
+    _rxHead(0), _rxLen(0), _rxCrcPos(2), _rxCrc(0),
+    _rxStartTime(0), _rxCrcTime(0), _channelsStartTime(0), _channelsCrcTime(0),
+    _isrMode(false), _isrBusy(false), _oobHead(0), _oobTail(0),
+    _txHead(0), _txCount(0), _txPos(0), _txHighWater(0), _txDropped(0),
+    _stats{}, _statsPerSec{}, _statsLastSec{}, _statsSecStart(0), _baud(baud),
+    _lastReceive(0), _lastChannelsPacket(0), _lastChannelsPacketUs(0),
+    _failsafeMinMs(CRSF_FAILSAFE_MIN_MS), _failsafeMaxMs(CRSF_FAILSAFE_STAGE1_MS), _linkIsUp(false),
+    _passthroughBaud(0), _maxBaud(0), _baudProposed(0), _baudProposedTime(0),
+    _baudRequest(0), _baudRequestOrigin(0), _baudRequestDest(0), _baudResponse(-1), _baudPending(0), _baudAfterFrames(0),
+    _baudVerifying(false), _baudChangeTime(0), _channelsPacked{0}, _channelsDecoded(0), _channelsSent{},
+    _channelsIntervalUs(4000), _channelsDueUs(0), _lastSync(0), _syncStats{}
+{
+    resetPacketInterval();
+}
+
+void CrsfSerial::begin(uint32_t baud)
+{
+    if (baud != 0)
+        _port.begin(baud);
+    else
+        _port.begin(_baud);
+
+    if (_rxTransport)
+        _rxTransport->begin();
+
+    cycleCountBegin();
+}
+
+// Call from main loop to update
+void CrsfSerial::loop()
+{
+    drainTx();
+    if (!getPassthroughMode())
+    {
+        // Hold off isrLoop() while the handshake is handled and the port may be reopened
+        _isrBusy = true;
+        checkBaudChange();
+        _isrBusy = false;
+        if (_telemetry)
+            _telemetry->loop();
+    }
+
+    if (_isrMode)
+    {
+        flushOobData();
+        if (!getPassthroughMode())
+            return;
+    }
+
+    handleSerialIn();
+}
+
+/***
+ * @brief: Call from interrupt context when in ISR mode, instead of receiving in loop()
+ * @details: Calls from interrupts of different priorities must not run at the same time,
+ *           a call which lands while another is in progress returns and the bytes
+ *           are picked up by the next call. Passthrough is always left to loop()
+ */
+void CrsfSerial::isrLoop()
+{
+    if (!_isrMode || getPassthroughMode() || _isrBusy)
+        return;
+
+    _isrBusy = true;
+    handleSerialIn();
+    _isrBusy = false;
+}
+
+/***
+ * @brief: Pass a byte which is not part of a frame to onOobData, via a buffer
+ *         for loop() to collect if in ISR mode
+ */
+void CrsfSerial::oobData(uint8_t b)
+{
+    if (!_isrMode)
+    {
+        if (onOobData)
+            onOobData(b);
+        return;
+    }
+
+    uint8_t next = (_oobHead + 1) % sizeof(_oobBuf);
+    if (next == _oobTail)
+    {
+        ++_stats.oobDropped;
+        return;
+    }
+    _oobBuf[_oobHead] = b;
+    _oobHead = next;
+}
+
+void CrsfSerial::flushOobData()
+{
+    while (_oobTail != _oobHead)
+    {
+        uint8_t b = _oobBuf[_oobTail];
+        _oobTail = (_oobTail + 1) % sizeof(_oobBuf);
+        if (onOobData)
+            onOobData(b);
+    }
+}
+
+
+void CrsfSerial::handleSerialIn()
+{
+    if (_rxTransport)
+    {
+        handleTransportIn();
+        return;
+    }
+
+    // Drain everything pending in chunks, with one receive timestamp per pass
+    unsigned int avail = _port.available();
+    if (avail)
+        _lastReceive = millis();
+
+    while (avail)
+    {
+        uint8_t buf[CRSF_MAX_PACKET_SIZE];
+        unsigned int cnt = (avail < sizeof(buf)) ? avail : sizeof(buf);
+        uint32_t start = cycleCount();
+        for (unsigned int i=0; i<cnt; ++i)
+            buf[i] = _port.read();
+        _stats.readCycles += cycleCount() - start;
+        avail -= cnt;
+
+        processBytes(buf, cnt);
+    }
+
+    checkPacketTimeout();
+    checkLinkDown();
+    updateStatsPerSec();
+}
+
+void CrsfSerial::handleTransportIn()
+{
+    // Parse each block in place where the transport received it
+    const uint8_t *buf;
+    uint32_t start = cycleCount();
+    size_t len = _rxTransport->peek(&buf);
+    _stats.readCycles += cycleCount() - start;
+    if (len)
+        _lastReceive = millis();
+
+    while (len)
+    {
+        processBytes(buf, len);
+        start = cycleCount();
+        _rxTransport->consume(len);
+        len = _rxTransport->peek(&buf);
+        _stats.readCycles += cycleCount() - start;
+    }
+    _stats.rxOverruns += _rxTransport->takeOverruns();
+
+    checkPacketTimeout();
+    checkLinkDown();
+    updateStatsPerSec();
+}
+
+/***
+ * @brief: Feed a block of received bytes to the CRSF parser
+ * @details: Bytes are passed to onOobData in passthrough mode, or if they
+ *           are not part of a valid CRSF frame
+ */
+void CrsfSerial::processBytes(const uint8_t *buf, size_t len)
+{
+    if (getPassthroughMode())
+    {
+        if (onOobData)
+            while (len--)
+                onOobData(*buf++);
+        return;
+    }
+
+    // Frame handlers take their time back out of parseCycles
+    uint32_t start = cycleCount();
+    _stats.bytes += len;
+    while (len--)
+    {
+        handleByteReceived(*buf++);
+
+        if (_rxLen == CRSF_MAX_PACKET_SIZE)
+        {
+            // Packet buffer filled and no valid packet found, dump the whole thing
+            ++_stats.overflows;
+            _stats.skippedBytes += _rxLen;
+            consumeRxBuffer(_rxLen);
+        }
+    }
+    _stats.parseCycles += cycleCount() - start;
+}
+
+void CrsfSerial::handleByteReceived(uint8_t b)
+{
+    if (_rxLen == 0)
+        _rxStartTime = cycleCount();
+    uint8_t pos = (_rxHead + _rxLen) % CRSF_MAX_PACKET_SIZE;
+    _rxBuf[pos] = b;
+    _rxBuf[pos + CRSF_MAX_PACKET_SIZE] = b;
+    ++_rxLen;
+
+    while (_rxLen > 1)
+    {
+        uint8_t *frame = &_rxBuf[_rxHead];
+        uint8_t len = frame[1];
+        // Sanity check the declared length isn't outside Type + X{1,CRSF_MAX_PAYLOAD_LEN} + CRC
+        // assumes there never will be a CRSF message that just has a type and no data (X)
+        if (len < 3 || len > (CRSF_MAX_PAYLOAD_LEN + 2))
+        {
+            consumeRxBuffer(1);
+            continue;
+        }
+
+        // Fold any bytes of Type + Payload not yet seen into the running crc. After a
+        // resync the crc may already cover bytes past this shorter frame, unfold those
+        uint8_t crcEnd = (_rxLen < len + 1) ? _rxLen : len + 1;
+        while (_rxCrcPos > crcEnd)
+            _rxCrc = Crc::removeLast(_rxCrc, frame[--_rxCrcPos]);
+        while (_rxCrcPos < crcEnd)
+            _rxCrc = Crc::update(_rxCrc, frame[_rxCrcPos++]);
+
+        // Wait for the rest of the packet
+        if (_rxLen < (len + 2))
+            break;
+
+        // CRC is the last byte, the packet is complete as soon as it arrives
+        if (_rxCrc == frame[len + 1])
+        {
+            _rxCrcTime = cycleCount();
+            processPacketIn(len);
+            consumeRxBuffer(len + 2);
+        }
+        else
+        {
+            ++_stats.crcErrors;
+            consumeRxBuffer(1);
+        }
+    }
+}
+
+void CrsfSerial::checkPacketTimeout()
+{
+    // If we haven't received data in a long time, flush the buffer a byte at a time (to trigger shiftyByte)
+    if (_rxLen > 0 && millis() - _lastReceive > CRSF_PACKET_TIMEOUT_MS)
+    {
+        ++_stats.timeouts;
+        while (_rxLen)
+            consumeRxBuffer(1);
+    }
+}
+
+void CrsfSerial::checkLinkDown()
+{
+    if (_linkIsUp && millis() - _lastChannelsPacket > _failsafeTimeoutMs)
+    {
+        if (onLinkDown)
+            onLinkDown();
+        _linkIsUp = false;
+    }
+}
+
+/***
+ * @brief: Once a second, compute the per second stats from the change in the totals
+ */
+void CrsfSerial::updateStatsPerSec()
+{
+    uint32_t now = millis();
+    if (now - _statsSecStart < 1000)
+        return;
+    _statsSecStart = now;
+
+    // The stats are all uint32_t counters
+    const uint32_t *total = (const uint32_t *)&_stats;
+    uint32_t *last = (uint32_t *)&_statsLastSec;
+    uint32_t *perSec = (uint32_t *)&_statsPerSec;
+    for (unsigned int i=0; i<sizeof(_stats)/sizeof(uint32_t); ++i)
+    {
+        perSec[i] = total[i] - last[i];
+        last[i] = total[i];
+    }
+}
+
+void CrsfSerial::processPacketIn(uint8_t len)
+{
+    const crsf_header_t *hdr = (crsf_header_t *)&_rxBuf[_rxHead];
+    uint32_t start = cycleCount();
+    // Any good frame means the other end is using the same baud
+    _baudVerifying = false;
+    switch (hdr->type)
+    {
+    case CRSF_FRAMETYPE_GPS:
+        ++_stats.frames[csfGps];
+        packetGps(hdr);
+        break;
+    case CRSF_FRAMETYPE_RC_CHANNELS_PACKED:
+        ++_stats.frames[csfChannels];
+        packetChannelsPacked(hdr);
+        break;
+    case CRSF_FRAMETYPE_SUBSET_RC_CHANNELS_PACKED:
+        ++_stats.frames[csfChannels];
+        packetSubsetChannels(hdr);
+        break;
+    case CRSF_FRAMETYPE_LINK_STATISTICS:
+        ++_stats.frames[csfLinkStatistics];
+        packetLinkStatistics(hdr);
+        break;
+    case CRSF_FRAMETYPE_RADIO_ID:
+        ++_stats.frames[csfOther];
+        packetRadioId(hdr);
+        break;
+    case CRSF_FRAMETYPE_COMMAND:
+        ++_stats.frames[csfOther];
+        packetCommand(hdr);
+        break;
+    default:
+        ++_stats.frames[csfOther];
+        break;
+    }
+    _stats.parseCycles -= cycleCount() - start;
+}
+
+/***
+ * @brief: Remove cnt bytes from the front of the RxBuf by advancing the read index
+ * @details: A single byte removed is not part of a valid frame and is passed to onOobData
+ */
+void CrsfSerial::consumeRxBuffer(uint8_t cnt)
+{
+    if (cnt == 1)
+    {
+        ++_stats.skippedBytes;
+        oobData(_rxBuf[_rxHead]);
+    }
+
+    // If removing the whole thing, just reset to the start
+    if (cnt >= _rxLen)
+    {
+        _rxHead = 0;
+        _rxLen = 0;
+        _rxCrcPos = 2;
+        _rxCrc = 0;
+        return;
+    }
+
+    if (cnt > 1)
+    {
+        // A whole frame was used, nothing after it has been folded yet
+        _rxCrcPos = 2;
+        _rxCrc = 0;
+    }
+    else if (_rxCrcPos > 2)
+    {
+        // Resync, the next frame starts one byte later. Take the old frame's first
+        // crc byte back out of the running crc so the bytes after it are not folded again
+        _rxCrc = Crc::removeFirst(_rxCrc, _rxBuf[_rxHead + 2], _rxCrcPos - 3);
+        --_rxCrcPos;
+    }
+
+    _rxHead = (_rxHead + cnt) % CRSF_MAX_PACKET_SIZE;
+    _rxLen -= cnt;
+    // The new first byte was received by now at the latest
+    _rxStartTime = cycleCount();
+}
+
+void CrsfSerial::packetChannelsPacked(const crsf_header_t *p)
+{
+    // Code assumes there is enough payload for all the channels
+    // Only the packed data is kept, channels are decoded when read with getChannel()
+    memcpy(_channelsPacked, p->data, sizeof(_channelsPacked));
+    _channelsDecoded = 0;
+    channelsReceived();
+}
+
+/***
+ * @brief: Update only the channels in a subset frame
+ * @details: The channels are decoded right away at their full resolution, and also
+ *           packed into the 11-bit channels so the view and snapshot stay complete
+ */
+void CrsfSerial::packetSubsetChannels(const crsf_header_t *p)
+{
+    uint8_t payloadLen = p->frame_size - 2;
+    unsigned int start = p->data[0] & CRSF_SUBSET_RC_STARTING_CHANNEL_MASK;
+    unsigned int res = (p->data[0] >> CRSF_SUBSET_RC_RES_SHIFT) & CRSF_SUBSET_RC_RES_MASK;
+    unsigned int bits = crsfSubsetBits(res);
+    unsigned int cnt = (payloadLen - 1) * 8 / bits;
+    if (start >= CRSF_NUM_CHANNELS || cnt == 0)
+        return;
+    if (cnt > CRSF_NUM_CHANNELS - start)
+        cnt = CRSF_NUM_CHANNELS - start;
+
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    crsfUnpackBits(&p->data[1], bits, cnt, raw);
+    for (unsigned int idx=0; idx<cnt; ++idx)
+    {
+        unsigned int ch = start + idx;
+        _channels[ch] = crsfSubsetToUsQ3(raw[idx], res);
+        _channelsDecoded |= 1U << ch;
+        crsfPackChannel(_channelsPacked, ch, crsfFromUsQ3(_channels[ch]));
+    }
+    channelsReceived();
+}
+
+void CrsfSerial::channelsReceived()
+{
+    // Publish for readers outside the parsing context
+    CrsfChannelSnapshot &snap = _channelSnapshot.beginWrite();
+    ++snap.seq;
+    snap.arrivalUs = micros();
+    memcpy(snap.packed, _channelsPacked, sizeof(snap.packed));
+    _channelSnapshot.endWrite();
+    _channelsStartTime = _rxStartTime;
+    _channelsCrcTime = _rxCrcTime;
+    updatePacketInterval();
+
+    if (!_linkIsUp && onLinkUp)
+        onLinkUp();
+    _linkIsUp = true;
+    _lastChannelsPacket = millis();
+
+    if (onPacketChannels)
+        onPacketChannels();
+}
+
+/***
+ * @brief: Add the time since the last channels packet to the packet interval estimate
+ * @details: The link down timeout is recalculated from the estimate every
+ *           CRSF_PACKET_INTERVAL_SAMPLES packets. The highest and lowest intervals
+ *           are discarded, so a single missed packet or late frame does not move it
+ */
+void CrsfSerial::updatePacketInterval()
+{
+    uint32_t now = micros();
+    uint32_t interval = now - _lastChannelsPacketUs;
+    _lastChannelsPacketUs = now;
+
+    // The gap before the link came up says nothing about the packet rate
+    if (!_linkIsUp)
+        return;
+
+    if (_packetIntervals.add(interval) != 0)
+        return;
+
+    _packetIntervalUs = _packetIntervals.calc();
+    uint32_t timeoutMs = _packetIntervalUs * CRSF_FAILSAFE_MISSED_PACKETS / 1000U;
+    _failsafeTimeoutMs = constrain(timeoutMs, _failsafeMinMs, _failsafeMaxMs);
+}
+
+/***
+ * @brief: Fall back to the fixed link down timeout until the packet interval is measured again
+ */
+void CrsfSerial::resetPacketInterval()
+{
+    _packetIntervals.clear();
+    _packetIntervalUs = 0;
+    _failsafeTimeoutMs = CRSF_FAILSAFE_STAGE1_MS;
+}
+
+void CrsfSerial::decodeChannel(unsigned int idx) const
+{
+    _channels[idx] = crsfToUsQ3(crsfUnpackChannel(_channelsPacked, idx));
+    _channelsDecoded |= 1U << idx;
+}
+
+void CrsfSerial::packetLinkStatistics(const crsf_header_t *p)
+{
+    const crsfLinkStatistics_t *link = (crsfLinkStatistics_t *)p->data;
+    // A new RF mode is a new packet rate, measure it again with the stage 1 timeout meanwhile
+    if (link->rf_Mode != _linkStatistics.rf_Mode)
+        resetPacketInterval();
+    memcpy(&_linkStatistics, link, sizeof(_linkStatistics));
+
+    // This is for the TX, but checkLinkDown() will keep triggering
+    // due to no channels coming in, so this is disabled for now
+    // bool linkIsUp = _linkStatistics.uplink_Link_quality != 0;
+    // if (linkIsUp != _linkIsUp)
+    // {
+    //     _linkIsUp = linkIsUp;
+    //     if (_linkIsUp && onLinkUp)
+    //         onLinkUp();
+    //     else if (!_linkIsUp && onLinkDown)
+    //         onLinkDown();
+    // }
+
+    if (onPacketLinkStatistics)
+        onPacketLinkStatistics(&_linkStatistics);
+}
+
+void CrsfSerial::packetGps(const crsf_header_t *p)
+{
+    const crsf_sensor_gps_t *gps = (crsf_sensor_gps_t *)p->data;
+    _gpsSensor.latitude = be32toh(gps->latitude);
+    _gpsSensor.longitude = be32toh(gps->longitude);
+    _gpsSensor.groundspeed = be16toh(gps->groundspeed);
+    _gpsSensor.heading = be16toh(gps->heading);
+    _gpsSensor.altitude = be16toh(gps->altitude);
+    _gpsSensor.satellites = gps->satellites;
+
+    if (onPacketGps)
+        onPacketGps(&_gpsSensor);
+}
+
+/***
+ * @brief: Timing from the TX module (CRSFShot), to send channels just before each RF packet
+ * @details: The module averages the offset over many packets and sends this a few
+ *           times a second, half the offset is applied each time so the schedule
+ *           settles without overshooting
+ */
+void CrsfSerial::packetRadioId(const crsf_header_t *p)
+{
+    const crsf_radio_timing_t *timing = (crsf_radio_timing_t *)p->data;
+    if (p->frame_size < sizeof(crsf_radio_timing_t) + 2 || timing->subtype != CRSF_FRAMETYPE_OPENTX_SYNC)
+        return;
+
+    uint32_t intervalUs = be32toh(timing->rate) / 10;
+    int32_t offsetUs = (int32_t)be32toh(timing->offset) / 10;
+    // 4Hz - 2kHz
+    if (intervalUs < 500 || intervalUs > 250000)
+        return;
+
+    _lastSync = millis();
+    _channelsDueUs += offsetUs / 2;
+    _syncStats.intervalUs = intervalUs;
+    _syncStats.phaseErrorUs = offsetUs;
+    uint32_t phaseError = (offsetUs < 0) ? -offsetUs : offsetUs;
+    if (phaseError > _syncStats.phaseErrorMaxUs)
+        _syncStats.phaseErrorMaxUs = phaseError;
+    ++_syncStats.syncFrames;
+}
+
+/***
+ * @brief: Baud negotiation, a speed proposal from the other end or the response to ours
+ * @details: Only recorded here as this may be running in an interrupt, the
+ *           response and the change of baud are done by checkBaudChange()
+ */
+void CrsfSerial::packetCommand(const crsf_header_t *p)
+{
+    // Dest + Origin + Command + Subcommand + ... + Command CRC
+    uint8_t payloadLen = p->frame_size - 2;
+    if (payloadLen < 5)
+        return;
+    if (CommandCrc::calc(&p->type, payloadLen) != p->data[payloadLen - 1])
+        return;
+
+    const uint8_t *cmd = p->data;
+    if (cmd[2] != CRSF_COMMAND_GENERAL)
+        return;
+
+    if (cmd[3] == CRSF_COMMAND_GENERAL_SPEED_PROPOSAL && payloadLen >= 10)
+    {
+        _baudRequestOrigin = cmd[1];
+        _baudRequestDest = cmd[0];
+        _baudRequest = (uint32_t)cmd[5] << 24 | (uint32_t)cmd[6] << 16 | (uint32_t)cmd[7] << 8 | cmd[8];
+    }
+    else if (cmd[3] == CRSF_COMMAND_GENERAL_SPEED_RESPONSE && payloadLen >= 7)
+    {
+        _baudResponse = cmd[5];
+    }
+}
+
+/***
+ * @brief: Queue a CRSF_COMMAND_GENERAL frame, adding the command crc
+ */
+bool CrsfSerial::queueCommand(uint8_t dest, uint8_t origin, uint8_t subcommand, const uint8_t *payload, uint8_t len)
+{
+    CrsfFrameWriter frame = reservePacket(CRSF_FRAMETYPE_COMMAND);
+    uint8_t hdr[] = { CRSF_FRAMETYPE_COMMAND, dest, origin, CRSF_COMMAND_GENERAL, subcommand };
+
+    uint8_t crc = CommandCrc::calc(hdr, sizeof(hdr));
+    for (unsigned int idx=0; idx<len; ++idx)
+        crc = CommandCrc::update(crc, payload[idx]);
+
+    return frame.bytes(&hdr[1], sizeof(hdr) - 1).bytes(payload, len).u8(crc).commit();
+}
+
+/***
+ * @brief: Propose the TX module changes to baud, the proposal is abandoned
+ *         if there's no response in CRSF_BAUD_RESPONSE_MS
+ */
+bool CrsfSerial::proposeBaud(uint32_t baud)
+{
+    uint8_t payload[] = { 0, (uint8_t)(baud >> 24), (uint8_t)(baud >> 16), (uint8_t)(baud >> 8), (uint8_t)baud }; // port_id, baud
+    if (!queueCommand(CRSF_ADDRESS_CRSF_TRANSMITTER, CRSF_ADDRESS_RADIO_TRANSMITTER,
+            CRSF_COMMAND_GENERAL_SPEED_PROPOSAL, payload, sizeof(payload)))
+        return false;
+    _baudProposed = baud;
+    _baudProposedTime = millis();
+    return true;
+}
+
+/***
+ * @brief: Answer a baud proposal, change baud when pending and
+ *         fall back to CRSF_BAUDRATE if the new baud is not working
+ * @details: The baud only changes between frames, with frames queued before
+ *           the change sent at the old baud and anything after at the new one.
+ *           Called with isrLoop() held off, so the fields packetCommand()
+ *           writes can't change underneath it
+ */
+void CrsfSerial::checkBaudChange()
+{
+    uint32_t now = millis();
+    if (_baudResponse != -1)
+    {
+        // The module changes baud after sending this, follow it right away
+        if (_baudResponse == 1 && _baudProposed != 0)
+        {
+            _baudPending = _baudProposed;
+            _baudAfterFrames = 0;
+        }
+        _baudProposed = 0;
+        _baudResponse = -1;
+    }
+    else if (_baudProposed != 0 && now - _baudProposedTime > CRSF_BAUD_RESPONSE_MS)
+        _baudProposed = 0;
+
+    if (_baudRequest != 0)
+    {
+        static const uint32_t CRSF_BAUDS[] = { 115200, 400000, 420000, 921600, 1870000, 2250000, 3750000, 5250000 };
+        bool accept = false;
+        for (unsigned int idx=0; idx<sizeof(CRSF_BAUDS)/sizeof(CRSF_BAUDS[0]); ++idx)
+            accept = accept || (CRSF_BAUDS[idx] == _baudRequest && _baudRequest <= _maxBaud);
+
+        uint8_t payload[] = { 0, accept }; // port_id, status
+        // The response must go out at the old baud, so try again next loop if there's no room
+        if (!isTxFull() && queueCommand(_baudRequestOrigin, _baudRequestDest,
+            CRSF_COMMAND_GENERAL_SPEED_RESPONSE, payload, sizeof(payload)))
+        {
+            if (accept)
+            {
+                _baudPending = _baudRequest;
+                _baudAfterFrames = _txCount;
+            }
+            _baudRequest = 0;
+        }
+    }
+
+    if (_baudPending != 0 && _baudAfterFrames == 0 && _txPos == 0)
+    {
+        changeBaud(_baudPending);
+        _baudPending = 0;
+        _baudVerifying = true;
+        _baudChangeTime = now;
+    }
+    else if (_baudVerifying && now - _baudChangeTime > CRSF_BAUD_FALLBACK_MS)
+    {
+        _baudVerifying = false;
+        changeBaud(CRSF_BAUDRATE);
+    }
+}
+
+/***
+ * @brief: Reopen the port at baud, keeping the transmit queue
+ */
+void CrsfSerial::changeBaud(uint32_t baud)
+{
+    _baud = baud;
+    _port.end(); // assumes flush()
+    // Anything partially received at the old baud is garbage
+    if (_rxLen)
+        consumeRxBuffer(_rxLen);
+    begin();
+    drainTx();
+}
+
+void CrsfSerial::write(uint8_t b)
+{
+    _port.write(b);
+}
+
+void CrsfSerial::write(const uint8_t *buf, size_t len)
+{
+    _port.write(buf, len);
+}
+
+/***
+ * @brief: Copy a frame into the transmit queue and start sending it
+ * @details: Never waits for the port, the frame is dropped if the queue is full
+ *           and the rest is sent from loop() as the port's buffer empties
+ */
+bool CrsfSerial::queuePacket(uint8_t type, const void *payload, uint8_t len)
+{
+    return reservePacket(type).bytes(payload, len).commit();
+}
+
+/***
+ * @brief: Start a frame of type in the next free transmit slot
+ * @return: A writer to append the payload, which is invalid if the queue is full
+ */
+CrsfFrameWriter CrsfSerial::reservePacket(uint8_t type)
+{
+    if (getPassthroughMode())
+        return CrsfFrameWriter(this, nullptr);
+    if (_txCount == CRSF_TX_SLOTS)
+    {
+        ++_txDropped;
+        return CrsfFrameWriter(this, nullptr);
+    }
+
+    uint8_t *frame = _txSlots[(_txHead + _txCount) % CRSF_TX_SLOTS].data;
+    frame[0] = CRSF_SYNC_BYTE;
+    frame[2] = type;
+    return CrsfFrameWriter(this, frame);
+}
+
+/***
+ * @brief: Add the length and crc to the reserved frame and queue it
+ */
+bool CrsfSerial::commitFrame(const uint8_t *frame, uint8_t len)
+{
+    // The writer must still be for the next free slot
+    unsigned int slot = (_txHead + _txCount) % CRSF_TX_SLOTS;
+    if (_txCount == CRSF_TX_SLOTS || frame != _txSlots[slot].data)
+        return false;
+
+    uint8_t *buf = _txSlots[slot].data;
+    buf[1] = len + 2; // type + payload + crc
+    buf[len+3] = Crc::calc(&buf[2], len + 1);
+    _txSlots[slot].len = len + 4;
+
+    ++_txCount;
+    if (_txCount > _txHighWater)
+        _txHighWater = _txCount;
+
+    drainTx();
+    return true;
+}
+
+/***
+ * @brief: Write as much of the transmit queue as fits in the port's transmit buffer
+ * @param block: Write the whole queue, waiting for the port as needed
+ */
+void CrsfSerial::drainTx(bool block)
+{
+    while (_txCount)
+    {
+        // Frames after a baud change wait for the new baud
+        if (_baudPending && _baudAfterFrames == 0 && _txPos == 0)
+            return;
+
+        uint8_t remain = _txSlots[_txHead].len - _txPos;
+        int room = block ? remain : _port.availableForWrite();
+        if (room <= 0)
+            return;
+
+        uint8_t cnt = (room < remain) ? room : remain;
+        _port.write(&_txSlots[_txHead].data[_txPos], cnt);
+        _txPos += cnt;
+        if (_txPos < _txSlots[_txHead].len)
+            return;
+
+        _txPos = 0;
+        _txHead = (_txHead + 1) % CRSF_TX_SLOTS;
+        --_txCount;
+        if (_baudAfterFrames)
+            --_baudAfterFrames;
+    }
+}
+
+/***
+ * @brief: Write 16 channels out as a handset would
+ * @details:    TX ONLY! Packs the us channel data which has been set with setChannel()
+ *              and writes it to the connected CRSF transmitter module.
+ *              External CRSF transmitters are usually half duplex inverted
+ *              and also scheduled by the module sending timing data, this
+ *              code handles none of that. This will, however, get a
+ *              transmitter to start transmitting channels.
+ */
+bool CrsfSerial::queuePacketChannels(bool changedOnly)
+{
+    if (changedOnly)
+    {
+        int first = -1;
+        int last = 0;
+        for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+        {
+            if (getChannelUsQ3(ch + 1) == _channelsSent[ch])
+                continue;
+            if (first == -1)
+                first = ch;
+            last = ch;
+        }
+        // The smallest frame keeps channels going when none changed
+        if (first == -1)
+            first = 0;
+        return queuePacketSubsetChannels(first + 1, last - first + 1);
+    }
+
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+        raw[ch] = crsfFromUsQ3(getChannelUsQ3(ch + 1));
+
+    // 11 bits per channel * 16 channels = 176 bits = 22 bytes
+    uint8_t packedChannels[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    crsfPackChannels(raw, packedChannels);
+
+    if (!queuePacket(CRSF_FRAMETYPE_RC_CHANNELS_PACKED, packedChannels, sizeof(packedChannels)))
+        return false;
+    for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+        _channelsSent[ch] = getChannelUsQ3(ch + 1);
+    return true;
+}
+
+bool CrsfSerial::queuePacketSubsetChannels(unsigned int first, unsigned int count, eCrsfSubsetRes res)
+{
+    if (first < 1 || first + count > CRSF_NUM_CHANNELS + 1 || count == 0)
+        return false;
+
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    for (unsigned idx=0; idx<count; ++idx)
+        raw[idx] = crsfSubsetFromUsQ3(getChannelUsQ3(first + idx), res);
+
+    uint8_t payload[CRSF_SUBSET_RC_MAX_PAYLOAD_SIZE];
+    payload[0] = (first - 1) | (res << CRSF_SUBSET_RC_RES_SHIFT);
+    unsigned len = 1 + crsfPackBits(raw, crsfSubsetBits(res), count, &payload[1]);
+
+    if (!queuePacket(CRSF_FRAMETYPE_SUBSET_RC_CHANNELS_PACKED, payload, len))
+        return false;
+    for (unsigned idx=0; idx<count; ++idx)
+        _channelsSent[first - 1 + idx] = getChannelUsQ3(first + idx);
+    return true;
+}
+
+/***
+ * @brief: Advance the channels schedule if the next channels frame is due
+ * @details: Schedule slips (rather than sending a burst) if it falls more than a
+ *           whole interval behind, e.g. after the module's rate was lowered
+ */
+bool CrsfSerial::isChannelsDue()
+{
+    uint32_t now = micros();
+    if ((int32_t)(now - _channelsDueUs) < 0)
+        return false;
+
+    uint32_t intervalUs = _channelsIntervalUs;
+    if (_syncStats.intervalUs != 0 && millis() - _lastSync < CRSF_SYNC_TIMEOUT_MS)
+        intervalUs = _syncStats.intervalUs;
+    else
+        _syncStats.intervalUs = 0;
+
+    uint32_t late = now - _channelsDueUs;
+    if (late >= intervalUs)
+    {
+        _channelsDueUs = now + intervalUs;
+        late = 0;
+    }
+    else
+        _channelsDueUs += intervalUs;
+
+    _syncStats.jitterUs = late;
+    if (late > _syncStats.jitterMaxUs)
+        _syncStats.jitterMaxUs = late;
+    return true;
+}
+
+/**
+ * @brief   Enter passthrough mode (serial sent directly to shiftybyte),
+ *          optionally changing the baud rate used during passthrough mode
+ * @param val
+ *          True to start passthrough mode, false to resume processing CRSF
+ * @param passthroughBaud
+ *          New baud rate for passthrough mode, or 0 to not change baud
+ *          Not used if disabling passthough
+*/
+void CrsfSerial::setPassthroughMode(bool val, uint32_t passthroughBaud)
+{
+    if (val)
+    {
+        // If not requesting any baud change
+        if (passthroughBaud == 0)
+        {
+            // Enter passthrough mode if not yet
+            if (_passthroughBaud == 0)
+                _passthroughBaud = _baud;
+            return;
+        }
+
+        _passthroughBaud = passthroughBaud;
+    }
+    else
+    {
+        // Not in passthrough, can't leave it any harder than we already are
+        if (_passthroughBaud == 0)
+            return;
+
+        // Leaving passthrough, but going back to same baud, just disable
+        if (_passthroughBaud == _baud)
+        {
+            _passthroughBaud = 0;
+            return;
+        }
+
+        _passthroughBaud = 0;
+    }
+
+    // Can only get here if baud is changing, send anything queued at the old
+    // baud (such as a reboot command), then close and reopen the port
+    drainTx(true);
+    _port.end(); // assumes flush()
+    begin(_passthroughBaud);
+}
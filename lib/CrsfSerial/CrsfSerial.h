@@ -1,69 +1,273 @@
-#pragma once
-
-#include <Arduino.h>
-#include <crc8.h>
-#include "crsf_protocol.h"
-
-enum eFailsafeAction { fsaNoPulses, fsaHold };
-
-class CrsfSerial
-{
-public:
-    // Packet timeout where buffer is flushed if no data is received in this time
-    static const unsigned int CRSF_PACKET_TIMEOUT_MS = 100;
-    static const unsigned int CRSF_FAILSAFE_STAGE1_MS = 300;
-
-    CrsfSerial(HardwareSerial &port, uint32_t baud = CRSF_BAUDRATE);
-    void begin(uint32_t baud = 0);
-    void loop();
-    void write(uint8_t b);
-    void write(const uint8_t *buf, size_t len);
-    void queuePacket(uint8_t type, const void *payload, uint8_t len);
-    void queuePacketChannels();
-
-    uint32_t getBaud() const { return _baud; };
-    // Return current channel value (1-based) in us
-    int getChannel(unsigned int ch) const { return _channels[ch - 1]; }
-    void setChannel(unsigned int ch, unsigned int value_us) { _channels[ch - 1] = value_us; }
-    const crsfLinkStatistics_t *getLinkStatistics() const { return &_linkStatistics; }
-    const crsf_sensor_gps_t *getGpsSensor() const { return &_gpsSensor; }
-    bool isLinkUp() const { return _linkIsUp; }
-    bool getPassthroughMode() const { return _passthroughBaud != 0; }
-    void setPassthroughMode(bool val, uint32_t passthroughBaud = 0);
-
-    // Event Handlers
-    void (*onLinkUp)();
-    void (*onLinkDown)();
-    // OobData is any byte which is not CRSF, including passthrough
-    void (*onOobData)(uint8_t b);
-    // CRSF Packet Callbacks
-    void (*onPacketChannels)();
-    void (*onPacketLinkStatistics)(crsfLinkStatistics_t *ls);
-    void (*onPacketGps)(crsf_sensor_gps_t *gpsSensor);
-
-private:
-    HardwareSerial &_port;
-    uint8_t _rxBuf[CRSF_MAX_PACKET_SIZE];
-    uint8_t _rxBufPos;
-    Crc8 _crc;
-    crsfLinkStatistics_t _linkStatistics;
-    crsf_sensor_gps_t _gpsSensor;
-    uint32_t _baud;
-    uint32_t _lastReceive;
-    uint32_t _lastChannelsPacket;
-    bool _linkIsUp;
-    uint32_t _passthroughBaud;
-    int _channels[CRSF_NUM_CHANNELS];
-
-    void handleSerialIn();
-    void handleByteReceived();
-    void shiftRxBuffer(uint8_t cnt);
-    void processPacketIn(uint8_t len);
-    void checkPacketTimeout();
-    void checkLinkDown();
-
-    // Packet Handlers
-    void packetChannelsPacked(const crsf_header_t *p);
-    void packetLinkStatistics(const crsf_header_t *p);
-    void packetGps(const crsf_header_t *p);
-};
+#pragma once
+
+#include <Arduino.h>
+#include <crc8.h>
+#include <cyclecount.h>
+#include <median.h>
+#include <seqlock.h>
+#include "crsf_protocol.h"
+#include "crsf_channels.h"
+#include "CrsfRxTransport.h"
+#include "CrsfFrameWriter.h"
+#include "CrsfTelemetry.h"
+
+enum eFailsafeAction { fsaNoPulses, fsaHold };
+
+// Frame types counted separately in crsfParserStats_t::frames
+enum eCrsfStatsFrame { csfChannels, csfLinkStatistics, csfGps, csfOther, csfCount };
+
+// Parser health counters, either totals or per second (see CrsfSerial::getStats())
+typedef struct tagCrsfParserStats {
+    uint32_t frames[csfCount];  // good frames of each type
+    uint32_t crcErrors;
+    uint32_t skippedBytes;      // bytes which were not part of a good frame, passed to onOobData
+    uint32_t overflows;         // full receive buffer with no frame found, dumped
+    uint32_t timeouts;          // partial frame flushed after no data for CRSF_PACKET_TIMEOUT_MS
+    uint32_t oobDropped;        // OobData bytes lost because loop() did not collect them in time (ISR mode)
+    uint32_t rxOverruns;        // rx transport buffers lost because loop() did not read them in time
+    uint32_t bytes;             // bytes parsed
+    uint32_t parseCycles;       // cycleCount() spent parsing, not counting the frame handlers and callbacks
+    uint32_t readCycles;        // cycleCount() spent getting the bytes from the port or rx transport
+} crsfParserStats_t;
+
+// Channels send timing when acting as a handset, see CrsfSerial::isChannelsDue()
+typedef struct tagCrsfSyncStats {
+    uint32_t syncFrames;        // timing frames received from the module
+    uint32_t intervalUs;        // interval requested by the module, 0 if not synced
+    int32_t phaseErrorUs;       // last offset reported by the module, positive is early
+    uint32_t phaseErrorMaxUs;   // largest offset either way
+    uint32_t jitterUs;          // how late the last channels were sent compared to the schedule
+    uint32_t jitterMaxUs;
+} crsfSyncStats_t;
+
+class CrsfSerial : private CrsfFrameSink
+{
+public:
+    typedef Crc8<CRSF_CRC_POLY> Crc;
+    typedef Crc8<CRSF_COMMAND_CRC_POLY> CommandCrc;
+
+    // Packet timeout where buffer is flushed if no data is received in this time
+    static const unsigned int CRSF_PACKET_TIMEOUT_MS = 100;
+    // Link down timeout until the packet interval is known, including for the
+    // CRSF_PACKET_INTERVAL_SAMPLES packets after every change of LinkStatistics rf_Mode
+    static const unsigned int CRSF_FAILSAFE_STAGE1_MS = 300;
+    // Once the packet interval is known, link down after this many packets in a row are missed
+    static const unsigned int CRSF_FAILSAFE_MISSED_PACKETS = 10;
+    static const unsigned int CRSF_FAILSAFE_MIN_MS = 50;
+    // Number of packet intervals the estimate is taken from
+    static const unsigned int CRSF_PACKET_INTERVAL_SAMPLES = 8;
+    // Channels are sent free running at the set interval if no timing frame is received for this long
+    static const unsigned int CRSF_SYNC_TIMEOUT_MS = 1000;
+    // Give up on a baud proposal with no response after this long
+    static const unsigned int CRSF_BAUD_RESPONSE_MS = 500;
+    // Go back to CRSF_BAUDRATE if no good frame is received this long after changing baud
+    static const unsigned int CRSF_BAUD_FALLBACK_MS = 1000;
+    // Number of outgoing frames which can be waiting for room in the port's transmit buffer
+    static const unsigned int CRSF_TX_SLOTS = 4;
+
+    CrsfSerial(HardwareSerial &port, uint32_t baud = CRSF_BAUDRATE);
+    void begin(uint32_t baud = 0);
+    void loop();
+    // Receive, parse and dispatch frames from interrupt context, see setIsrMode()
+    void isrLoop();
+    void processBytes(const uint8_t *buf, size_t len);
+    void write(uint8_t b);
+    void write(const uint8_t *buf, size_t len);
+    // Queue a frame to be sent without blocking, returns false if it was dropped
+    bool queuePacket(uint8_t type, const void *payload, uint8_t len);
+    // Build a frame in place in the transmit queue, invalid if the queue is full
+    CrsfFrameWriter reservePacket(uint8_t type);
+    // Send all the channels, or with changedOnly a subset frame from the first to the last channel
+    // changed since channels were last sent (only channel 1 if none changed)
+    bool queuePacketChannels(bool changedOnly = false);
+    // Send count channels from first (1-based) as a subset frame, limited to 988-2012us
+    bool queuePacketSubsetChannels(unsigned int first, unsigned int count, eCrsfSubsetRes res = csr11Bit);
+    // For handsets, true when the next channels frame should be queued. Channels are sent at the
+    // rate and phase requested by the module's timing frames (CRSFShot), or every intervalUs
+    // set by setChannelsInterval() until they are received
+    bool isChannelsDue();
+    void setChannelsInterval(uint32_t intervalUs) { _channelsIntervalUs = intervalUs; }
+    const crsfSyncStats_t &getSyncStats() const { return _syncStats; }
+
+    uint32_t getBaud() const { return _baud; };
+    // Ask the TX module (as a handset) to change baud, switches if it accepts
+    bool proposeBaud(uint32_t baud);
+    // Highest baud accepted when the other end proposes a change, 0 (default) to refuse them all
+    void setMaxBaud(uint32_t baud) { _maxBaud = baud; }
+    // Return current channel value (1-based) in us, decoded from the last channels packet on first use
+    int getChannel(unsigned int ch) const { return getChannelUsQ3(ch) >> CRSF_US_Q3_SHIFT; }
+    // Return current channel value (1-based) in 1/8us units, which keeps the full CRSF resolution
+    int getChannelUsQ3(unsigned int ch) const
+    {
+        unsigned int idx = ch - 1;
+        if ((_channelsDecoded & (1U << idx)) == 0)
+            decodeChannel(idx);
+        return _channels[idx];
+    }
+    void setChannel(unsigned int ch, unsigned int value_us)
+    {
+        _channels[ch - 1] = value_us << CRSF_US_Q3_SHIFT;
+        _channelsDecoded |= 1U << (ch - 1);
+    }
+    // Decode all the channels in MASK (bit 0 = channel 1) in one pass, for channels which are known to be used
+    template <uint32_t MASK>
+    void decodeChannels() const
+    {
+        uint16_t raw[CRSF_NUM_CHANNELS];
+        CrsfChannelPacker<0, CRSF_NUM_CHANNELS>::template unpackMasked<MASK>(_channelsPacked, raw);
+        uint32_t pending = MASK & ~_channelsDecoded;
+        for (unsigned int idx=0; idx<CRSF_NUM_CHANNELS; ++idx)
+            if (pending & (1U << idx))
+                _channels[idx] = crsfToUsQ3(raw[idx]);
+        _channelsDecoded |= MASK;
+    }
+    // Zero-copy access to the last received channels payload
+    CrsfChannelsView getChannelsView() const { return CrsfChannelsView(_channelsPacked); }
+    // cycleCount() when the last channels frame's first byte was parsed, and when its crc passed
+    uint32_t getChannelsStartTime() const { return _channelsStartTime; }
+    uint32_t getChannelsCrcTime() const { return _channelsCrcTime; }
+    // Parser counters since startup
+    const crsfParserStats_t &getStats() const { return _stats; }
+    // Parser counters over the last full second
+    const crsfParserStats_t &getStatsPerSec() const { return _statsPerSec; }
+    const crsfLinkStatistics_t *getLinkStatistics() const { return &_linkStatistics; }
+    const crsf_sensor_gps_t *getGpsSensor() const { return &_gpsSensor; }
+    bool isLinkUp() const { return _linkIsUp; }
+    // Frames dropped because the transmit queue was full, and the most frames ever queued
+    uint32_t getTxDropped() const { return _txDropped; }
+    uint8_t getTxHighWater() const { return _txHighWater; }
+    bool isTxFull() const { return _txCount == CRSF_TX_SLOTS; }
+    // Measured channels packet interval, 0 until enough packets have been received. Reset to 0
+    // when rf_Mode changes, it is not seeded from the new mode as the rates each rf_Mode value
+    // stands for differ between Crossfire and ELRS versions
+    uint32_t getPacketIntervalUs() const { return _packetIntervalUs; }
+    uint32_t getFailsafeTimeoutMs() const { return _failsafeTimeoutMs; }
+    // Bounds for the link down timeout derived from the packet interval
+    void setFailsafeLimits(uint32_t minMs, uint32_t maxMs) { _failsafeMinMs = minMs; _failsafeMaxMs = maxMs; }
+    bool getPassthroughMode() const { return _passthroughBaud != 0; }
+    void setPassthroughMode(bool val, uint32_t passthroughBaud = 0);
+    // Receive from transport instead of reading the port, must be set before begin()
+    void setRxTransport(CrsfRxTransport *transport) { _rxTransport = transport; }
+    // Send the telemetry sensors from loop()
+    void setTelemetry(CrsfTelemetry *telemetry) { _telemetry = telemetry; }
+    // Enable after begin() to have frames received and all the callbacks except onOobData
+    // run from isrLoop(), called from a periodic interrupt and / or receive interrupt.
+    // loop() then only passes OobData on, or handles everything while in passthrough mode
+    void setIsrMode(bool val) { _isrMode = val; }
+    // Copy of the last channels frame, which never mixes two frames even if frames are
+    // parsed in an interrupt or on another core. Must not be called from an interrupt
+    // which can preempt the parsing
+    void getChannelSnapshot(CrsfChannelSnapshot &snap) const { _channelSnapshot.read(snap); }
+
+    // Event Handlers
+    void (*onLinkUp)();
+    void (*onLinkDown)();
+    // OobData is any byte which is not CRSF, including passthrough
+    void (*onOobData)(uint8_t b);
+    // CRSF Packet Callbacks
+    void (*onPacketChannels)();
+    void (*onPacketLinkStatistics)(crsfLinkStatistics_t *ls);
+    void (*onPacketGps)(crsf_sensor_gps_t *gpsSensor);
+
+private:
+    HardwareSerial &_port;
+    CrsfRxTransport *_rxTransport;
+    CrsfTelemetry *_telemetry;
+    // Receive ring buffer, every byte is stored twice (at pos and pos + CRSF_MAX_PACKET_SIZE)
+    // so the frame starting at _rxHead is always contiguous in memory without copying
+    uint8_t _rxBuf[CRSF_MAX_PACKET_SIZE * 2];
+    uint8_t _rxHead; // index of the first byte of the frame being assembled
+    uint8_t _rxLen;  // number of bytes in the ring starting at _rxHead
+    uint8_t _rxCrcPos; // index in the frame of the next byte to fold into _rxCrc
+    uint8_t _rxCrc;  // running crc of the frame's Type + Payload received so far
+    uint32_t _rxStartTime; // cycleCount() when the byte at _rxHead was parsed
+    uint32_t _rxCrcTime;
+    uint32_t _channelsStartTime;
+    uint32_t _channelsCrcTime;
+    bool _isrMode;
+    volatile bool _isrBusy;
+    // OobData found in isrLoop(), collected by loop()
+    uint8_t _oobBuf[64];
+    volatile uint8_t _oobHead;
+    volatile uint8_t _oobTail;
+    // Transmit queue of whole frames, fed to the port as its buffer has room
+    struct {
+        uint8_t len;
+        uint8_t data[CRSF_MAX_PACKET_SIZE];
+    } _txSlots[CRSF_TX_SLOTS];
+    uint8_t _txHead;  // slot being sent
+    uint8_t _txCount;
+    uint8_t _txPos;   // bytes of the head slot already sent
+    uint8_t _txHighWater;
+    uint32_t _txDropped;
+    crsfParserStats_t _stats;
+    crsfParserStats_t _statsPerSec;
+    crsfParserStats_t _statsLastSec; // _stats at the start of the current second
+    uint32_t _statsSecStart;
+    crsfLinkStatistics_t _linkStatistics;
+    crsf_sensor_gps_t _gpsSensor;
+    uint32_t _baud;
+    uint32_t _lastReceive;
+    uint32_t _lastChannelsPacket;
+    uint32_t _lastChannelsPacketUs;
+    MedianAvgFilter<uint32_t, CRSF_PACKET_INTERVAL_SAMPLES> _packetIntervals;
+    uint32_t _packetIntervalUs;
+    uint32_t _failsafeTimeoutMs;
+    uint32_t _failsafeMinMs;
+    uint32_t _failsafeMaxMs;
+    bool _linkIsUp;
+    uint32_t _passthroughBaud;
+    // Baud negotiation
+    uint32_t _maxBaud;
+    uint32_t _baudProposed;     // sent by proposeBaud(), waiting for the response
+    uint32_t _baudProposedTime;
+    // Written by packetCommand(), which may be in an interrupt, and handled by checkBaudChange()
+    volatile uint32_t _baudRequest;     // proposed by the other end, to be answered from loop()
+    volatile uint8_t _baudRequestOrigin;
+    volatile uint8_t _baudRequestDest;
+    volatile int8_t _baudResponse;      // status of the response to our proposal (1 = accepted), -1 if none yet
+    uint32_t _baudPending;      // switch to this baud once _baudAfterFrames more frames have been sent
+    uint8_t _baudAfterFrames;
+    volatile bool _baudVerifying;   // no good frame received since the baud changed
+    uint32_t _baudChangeTime;
+    uint8_t _channelsPacked[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    // Cache of channels in 1/8us, only valid for channels with their bit set in _channelsDecoded
+    mutable int _channels[CRSF_NUM_CHANNELS];
+    mutable uint32_t _channelsDecoded;
+    // Values last sent by queuePacketChannels(), in 1/8us
+    int _channelsSent[CRSF_NUM_CHANNELS];
+    SeqLock<CrsfChannelSnapshot> _channelSnapshot;
+    // Channels send schedule
+    uint32_t _channelsIntervalUs;
+    uint32_t _channelsDueUs;
+    uint32_t _lastSync;
+    crsfSyncStats_t _syncStats;
+
+    void handleSerialIn();
+    void handleTransportIn();
+    void handleByteReceived(uint8_t b);
+    void oobData(uint8_t b);
+    void flushOobData();
+    void drainTx(bool block = false);
+    bool commitFrame(const uint8_t *frame, uint8_t len) override;
+    void consumeRxBuffer(uint8_t cnt);
+    void processPacketIn(uint8_t len);
+    void checkPacketTimeout();
+    void checkLinkDown();
+    void checkBaudChange();
+    void changeBaud(uint32_t baud);
+    bool queueCommand(uint8_t dest, uint8_t origin, uint8_t subcommand, const uint8_t *payload, uint8_t len);
+    void updateStatsPerSec();
+    void updatePacketInterval();
+    void resetPacketInterval();
+    void decodeChannel(unsigned int idx) const;
+
+    // Packet Handlers
+    void packetChannelsPacked(const crsf_header_t *p);
+    void packetSubsetChannels(const crsf_header_t *p);
+    void channelsReceived();
+    void packetLinkStatistics(const crsf_header_t *p);
+    void packetGps(const crsf_header_t *p);
+    void packetRadioId(const crsf_header_t *p);
+    void packetCommand(const crsf_header_t *p);
+};
@@ -0,0 +1,132 @@
+#include "CrsfTelemetry.h"
+#include "CrsfSerial.h"
+
+// Sync + Len + Type + CRC around the payload
+#define CRSF_FRAME_OVERHEAD 4
+
+CrsfTelemetry::CrsfTelemetry(CrsfSerial &crsf) :
+    _crsf(crsf), _scratchId(-1), _sensorCnt(0), _ratio(CRSF_TELEMETRY_RATIO), _fixedBps(0),
+    _bps(CRSF_TELEMETRY_MIN_BPS), _tokens(0), _lastRefill(0), _sent(0), _coalesced(0)
+{
+}
+
+int CrsfTelemetry::addSensor(uint8_t frameType, uint8_t priority, uint16_t intervalMs)
+{
+    if (_sensorCnt == CRSF_TELEMETRY_SENSORS)
+        return -1;
+
+    int id = _sensorCnt++;
+    _sensors[id].priority = priority;
+    _sensors[id].pending = false;
+    _sensors[id].intervalMs = (intervalMs != 0) ? intervalMs : 1;
+    _sensors[id].lastSent = millis() - _sensors[id].intervalMs;
+    _sensors[id].len = 0;
+    _sensors[id].frame[0] = CRSF_SYNC_BYTE;
+    _sensors[id].frame[2] = frameType;
+    return id;
+}
+
+CrsfFrameWriter CrsfTelemetry::update(int id)
+{
+    if (id < 0 || id >= _sensorCnt)
+        return CrsfFrameWriter(this, nullptr);
+    _scratchId = id;
+    return CrsfFrameWriter(this, _scratch);
+}
+
+bool CrsfTelemetry::commitFrame(const uint8_t *frame, uint8_t len)
+{
+    // A writer which overflowed or was never committed leaves the pending value as it was
+    int id = _scratchId;
+    if (frame != _scratch || id < 0)
+        return false;
+    _scratchId = -1;
+
+    if (_sensors[id].pending)
+        ++_coalesced;
+    memcpy(&_sensors[id].frame[3], &_scratch[3], len);
+    _sensors[id].len = len;
+    _sensors[id].pending = true;
+    return true;
+}
+
+/***
+ * @brief: Send the pending sensor which is the most overdue, if the budget allows
+ * @details: Lateness is the time since the sensor was last sent relative to its
+ *           interval, weighted by priority. Sensors are never sent faster than their
+ *           interval, and a sensor waiting for budget blocks lower scoring ones so a
+ *           stream of small frames can not starve a large one
+ */
+void CrsfTelemetry::loop()
+{
+    uint32_t now = millis();
+    refill(now);
+
+    int best = -1;
+    uint32_t bestScore = 0;
+    for (unsigned int id=0; id<_sensorCnt; ++id)
+    {
+        if (!_sensors[id].pending)
+            continue;
+        uint32_t elapsed = now - _sensors[id].lastSent;
+        if (elapsed < _sensors[id].intervalMs)
+            continue;
+
+        // Limited so the score can't overflow
+        if (elapsed > 60000U)
+            elapsed = 60000U;
+        uint32_t score = elapsed * 16U * (_sensors[id].priority + 1U) / _sensors[id].intervalMs;
+        if (best == -1 || score > bestScore)
+        {
+            best = id;
+            bestScore = score;
+        }
+    }
+    if (best == -1)
+        return;
+
+    uint32_t cost = (_sensors[best].len + CRSF_FRAME_OVERHEAD) * 1000U;
+    if (_tokens < cost || _crsf.getPassthroughMode() || _crsf.isTxFull())
+        return;
+
+    if (!_crsf.queuePacket(_sensors[best].frame[2], &_sensors[best].frame[3], _sensors[best].len))
+        return;
+    _tokens -= cost;
+    _sensors[best].pending = false;
+    _sensors[best].lastSent = now;
+    ++_sent;
+}
+
+/***
+ * @brief: Add the budget for the time since the last refill
+ * @details: At most one maximum size frame of budget is saved up, so
+ *           telemetry does not burst after being idle
+ */
+void CrsfTelemetry::refill(uint32_t now)
+{
+    uint32_t elapsed = now - _lastRefill;
+    if (elapsed == 0)
+        return;
+    _lastRefill = now;
+    _bps = (_fixedBps != 0) ? _fixedBps : estimateBudget();
+
+    if (elapsed > 1000U)
+        elapsed = 1000U;
+    _tokens += _bps * elapsed;
+    if (_tokens > CRSF_MAX_PACKET_SIZE * 1000U)
+        _tokens = CRSF_MAX_PACKET_SIZE * 1000U;
+}
+
+/***
+ * @brief: Downlink bytes per second from the packet rate, telemetry ratio and downlink LQ
+ */
+uint32_t CrsfTelemetry::estimateBudget() const
+{
+    uint32_t intervalUs = _crsf.getPacketIntervalUs();
+    if (intervalUs == 0 || !_crsf.isLinkUp())
+        return CRSF_TELEMETRY_MIN_BPS;
+
+    uint32_t bps = 1000000U * CRSF_TELEMETRY_BYTES_PER_PACKET / (intervalUs * _ratio);
+    bps = bps * _crsf.getLinkStatistics()->downlink_Link_quality / 100U;
+    return (bps > CRSF_TELEMETRY_MIN_BPS) ? bps : CRSF_TELEMETRY_MIN_BPS;
+}
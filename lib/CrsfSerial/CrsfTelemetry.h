@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include "crsf_protocol.h"
+#include "CrsfFrameWriter.h"
+
+class CrsfSerial;
+
+/**
+ * Schedules telemetry frames sent to the receiver so they fit in the downlink.
+ * Each sensor has a priority, a target interval and one slot holding its latest
+ * value, so an update before the previous value was sent replaces it instead of
+ * queueing both. Each loop() sends the most overdue sensor if there is enough
+ * byte budget. The budget is estimated from the measured packet rate, the
+ * telemetry ratio and the downlink LQ, or can be fixed with setBudget().
+ * Attach to CrsfSerial with setTelemetry() to have it run from CrsfSerial::loop()
+ */
+class CrsfTelemetry : private CrsfFrameSink
+{
+public:
+    static const unsigned int CRSF_TELEMETRY_SENSORS = 8;
+    // One telemetry packet every this many packets (1:8)
+    static const unsigned int CRSF_TELEMETRY_RATIO = 8;
+    // Bytes of CRSF frame carried by each downlink telemetry packet
+    static const unsigned int CRSF_TELEMETRY_BYTES_PER_PACKET = 5;
+    // Budget in bytes per second until the packet rate is known, and the lowest estimate
+    static const unsigned int CRSF_TELEMETRY_MIN_BPS = 20;
+
+    CrsfTelemetry(CrsfSerial &crsf);
+
+    // Returns the sensor id to update(), or -1 if all the sensors are used.
+    // A higher priority sensor is picked over a lower one which is less than (priority + 1) times as late
+    int addSensor(uint8_t frameType, uint8_t priority, uint16_t intervalMs);
+    // Write the latest value of sensor id, replacing any value which has not been sent yet
+    // once committed. Only one update can be in progress at a time
+    CrsfFrameWriter update(int id);
+    void loop();
+
+    // Fixed budget in bytes per second, or 0 to estimate it from the link
+    void setBudget(uint32_t bytesPerSec) { _fixedBps = bytesPerSec; }
+    // Packets per telemetry packet, as configured in the receiver
+    void setRatio(uint8_t ratio) { _ratio = (ratio != 0) ? ratio : 1; }
+    // Budget in use in bytes per second
+    uint32_t getBudget() const { return _bps; }
+    // Frames sent, and values replaced before they were sent
+    uint32_t getSent() const { return _sent; }
+    uint32_t getCoalesced() const { return _coalesced; }
+
+private:
+    CrsfSerial &_crsf;
+    struct {
+        uint8_t priority;
+        bool pending;
+        uint16_t intervalMs;
+        uint32_t lastSent;
+        uint8_t len;
+        uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    } _sensors[CRSF_TELEMETRY_SENSORS];
+    // update() builds here so the pending value is untouched until commit
+    uint8_t _scratch[CRSF_MAX_PACKET_SIZE];
+    int _scratchId;
+    uint8_t _sensorCnt;
+    uint8_t _ratio;
+    uint32_t _fixedBps;
+    uint32_t _bps;
+    uint32_t _tokens; // budget saved up, in 1/1000 bytes
+    uint32_t _lastRefill;
+    uint32_t _sent;
+    uint32_t _coalesced;
+
+    bool commitFrame(const uint8_t *frame, uint8_t len) override;
+    void refill(uint32_t now);
+    uint32_t estimateBudget() const;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "crsf_protocol.h"
+
+#if (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "crsf_channels.h word access assumes a little endian CPU"
+#endif
+
+/**
+ * Conversion and packing helpers for the 11-bit channels in a
+ * CRSF_FRAMETYPE_RC_CHANNELS_PACKED payload
+ */
+
+// Q3 values are microseconds in 1/8us fixed point, which represents
+// every 0.625us CRSF step exactly
+#define CRSF_US_Q3_SHIFT    3
+
+// usQ3 = (crsf * 5/8 + 880) * 8, exact
+static inline unsigned crsfToUsQ3(unsigned crsf)
+{
+    return (crsf * 5U) + ((1500 - 620) << CRSF_US_Q3_SHIFT);
+}
+
+// us = crsf * 5/8 + 880, same result as CRSF_to_US() for all 11-bit values
+static inline unsigned crsfToUs(unsigned crsf)
+{
+    return crsfToUsQ3(crsf) >> CRSF_US_Q3_SHIFT;
+}
+
+// crsf = usQ3 / 5 - 1408, for usQ3 in 7040-65535
+// The /5 is a multiply by 0xCCCD >> 18, which is exact for values < 65536
+static inline unsigned crsfFromUsQ3(unsigned usQ3)
+{
+    return ((usQ3 * 0xCCCDU) >> 18) - (2400 - CRSF_CHANNEL_VALUE_MID);
+}
+
+// crsf = us * 8/5 - 1408, same result as US_to_CRSF() for us in 880-8191
+static inline unsigned crsfFromUs(unsigned us)
+{
+    return crsfFromUsQ3(us << CRSF_US_Q3_SHIFT);
+}
+
+/**
+ * Location of channel CH in the packed payload. Each channel is read as the
+ * 32-bit little endian word at BYTE shifted down by SHIFT. The last words are
+ * moved back so they never read past the end of the 22 byte payload
+ */
+template <unsigned CH>
+struct CrsfChannelPos
+{
+    static constexpr unsigned BIT = CH * CRSF_BITS_PER_CHANNEL;
+    static constexpr unsigned BYTE = (BIT / 8 + 4 > CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE) ?
+        (CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE - 4) : (BIT / 8);
+    static constexpr unsigned SHIFT = BIT - BYTE * 8;
+    static constexpr uint32_t MASK = (1U << CRSF_BITS_PER_CHANNEL) - 1;
+};
+
+static inline uint32_t crsfLoad32(const uint8_t *p)
+{
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static inline void crsfStore32(uint8_t *p, uint32_t val)
+{
+    memcpy(p, &val, sizeof(val));
+}
+
+// Unrolled at compile time, one word load per channel
+template <unsigned CH, unsigned END>
+struct CrsfChannelPacker
+{
+    typedef CrsfChannelPos<CH> Pos;
+
+    static inline void unpack(const uint8_t *payload, uint16_t *raw)
+    {
+        raw[CH] = (crsfLoad32(&payload[Pos::BYTE]) >> Pos::SHIFT) & Pos::MASK;
+        CrsfChannelPacker<CH + 1, END>::unpack(payload, raw);
+    }
+
+    // Only unpack the channels with their bit set in MASK
+    template <uint32_t MASK>
+    static inline void unpackMasked(const uint8_t *payload, uint16_t *raw)
+    {
+        if (MASK & (1U << CH))
+            raw[CH] = (crsfLoad32(&payload[Pos::BYTE]) >> Pos::SHIFT) & Pos::MASK;
+        CrsfChannelPacker<CH + 1, END>::template unpackMasked<MASK>(payload, raw);
+    }
+
+    static inline void pack(const uint16_t *raw, uint8_t *payload)
+    {
+        uint32_t word = crsfLoad32(&payload[Pos::BYTE]);
+        word |= (raw[CH] & Pos::MASK) << Pos::SHIFT;
+        crsfStore32(&payload[Pos::BYTE], word);
+        CrsfChannelPacker<CH + 1, END>::pack(raw, payload);
+    }
+};
+
+template <unsigned END>
+struct CrsfChannelPacker<END, END>
+{
+    static inline void unpack(const uint8_t *, uint16_t *) {}
+    template <uint32_t MASK>
+    static inline void unpackMasked(const uint8_t *, uint16_t *) {}
+    static inline void pack(const uint16_t *, uint8_t *) {}
+};
+
+// Unpack a single raw 11-bit value, ch is 0-based
+static inline unsigned crsfUnpackChannel(const uint8_t *payload, unsigned ch)
+{
+    unsigned bit = ch * CRSF_BITS_PER_CHANNEL;
+    unsigned byte = bit / 8;
+    if (byte > CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE - 4)
+        byte = CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE - 4;
+    return (crsfLoad32(&payload[byte]) >> (bit - byte * 8)) & ((1U << CRSF_BITS_PER_CHANNEL) - 1);
+}
+
+// Replace a single raw 11-bit value in a channels payload, ch is 0-based
+static inline void crsfPackChannel(uint8_t *payload, unsigned ch, unsigned raw)
+{
+    unsigned bit = ch * CRSF_BITS_PER_CHANNEL;
+    unsigned byte = bit / 8;
+    if (byte > CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE - 4)
+        byte = CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE - 4;
+    unsigned shift = bit - byte * 8;
+    uint32_t mask = ((1U << CRSF_BITS_PER_CHANNEL) - 1) << shift;
+    uint32_t word = crsfLoad32(&payload[byte]);
+    crsfStore32(&payload[byte], (word & ~mask) | ((raw << shift) & mask));
+}
+
+// Unpack all CRSF_NUM_CHANNELS raw 11-bit values from a channels payload
+static inline void crsfUnpackChannels(const uint8_t *payload, uint16_t *raw)
+{
+    CrsfChannelPacker<0, CRSF_NUM_CHANNELS>::unpack(payload, raw);
+}
+
+// Pack CRSF_NUM_CHANNELS raw 11-bit values into a CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE payload
+static inline void crsfPackChannels(const uint16_t *raw, uint8_t *payload)
+{
+    memset(payload, 0, CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE);
+    CrsfChannelPacker<0, CRSF_NUM_CHANNELS>::pack(raw, payload);
+}
+
+/**
+ * CRSF_FRAMETYPE_SUBSET_RC_CHANNELS_PACKED payload: a config byte with the 0-based
+ * first channel and the resolution, then the channels packed LSB first at 10-13
+ * bits each. Every resolution spans 988-2012us, in 1us (10 bit) to 1/8us (13 bit) steps
+ */
+enum eCrsfSubsetRes { csr10Bit, csr11Bit, csr12Bit, csr13Bit };
+#define CRSF_SUBSET_RC_STARTING_CHANNEL_MASK    0x1f
+#define CRSF_SUBSET_RC_RES_SHIFT                5
+#define CRSF_SUBSET_RC_RES_MASK                 0x03
+#define CRSF_SUBSET_RC_US_MIN                   988
+// Config byte + 16 channels at 13 bits
+#define CRSF_SUBSET_RC_MAX_PAYLOAD_SIZE         (1 + (CRSF_NUM_CHANNELS * 13 + 7) / 8)
+
+static inline unsigned crsfSubsetBits(unsigned res)
+{
+    return 10 + res;
+}
+
+// usQ3 = (988 + raw / 2^res) * 8
+static inline unsigned crsfSubsetToUsQ3(unsigned raw, unsigned res)
+{
+    return (CRSF_SUBSET_RC_US_MIN << CRSF_US_Q3_SHIFT) + ((raw << CRSF_US_Q3_SHIFT) >> res);
+}
+
+// raw = (usQ3 / 8 - 988) * 2^res, limited to the range of the resolution
+static inline unsigned crsfSubsetFromUsQ3(unsigned usQ3, unsigned res)
+{
+    const unsigned minQ3 = CRSF_SUBSET_RC_US_MIN << CRSF_US_Q3_SHIFT;
+    const unsigned maxRaw = (1U << crsfSubsetBits(res)) - 1;
+    unsigned raw = (usQ3 > minQ3) ? ((usQ3 - minQ3) << res) >> CRSF_US_Q3_SHIFT : 0;
+    return (raw < maxRaw) ? raw : maxRaw;
+}
+
+// Unpack cnt values of bits each, packed LSB first
+static inline void crsfUnpackBits(const uint8_t *data, unsigned bits, unsigned cnt, uint16_t *raw)
+{
+    uint32_t acc = 0;
+    unsigned accBits = 0;
+    for (unsigned idx=0; idx<cnt; ++idx)
+    {
+        while (accBits < bits)
+        {
+            acc |= (uint32_t)*data++ << accBits;
+            accBits += 8;
+        }
+        raw[idx] = acc & ((1U << bits) - 1);
+        acc >>= bits;
+        accBits -= bits;
+    }
+}
+
+// Pack cnt values of bits each LSB first, returns the number of bytes used
+static inline unsigned crsfPackBits(const uint16_t *raw, unsigned bits, unsigned cnt, uint8_t *data)
+{
+    uint32_t acc = 0;
+    unsigned accBits = 0;
+    unsigned len = 0;
+    for (unsigned idx=0; idx<cnt; ++idx)
+    {
+        acc |= (uint32_t)(raw[idx] & ((1U << bits) - 1)) << accBits;
+        accBits += bits;
+        while (accBits >= 8)
+        {
+            data[len++] = acc;
+            acc >>= 8;
+            accBits -= 8;
+        }
+    }
+    if (accBits)
+        data[len++] = acc;
+    return len;
+}
+
+/**
+ * Read-only view of a packed channels payload, decoding only the channels
+ * which are accessed. Channels are 1-based like CrsfSerial::getChannel()
+ */
+class CrsfChannelsView
+{
+public:
+    CrsfChannelsView(const uint8_t *payload) : _payload(payload) {}
+    unsigned getRaw(unsigned ch) const { return crsfUnpackChannel(_payload, ch - 1); }
+    int getUs(unsigned ch) const { return crsfToUs(getRaw(ch)); }
+    int getUsQ3(unsigned ch) const { return crsfToUsQ3(getRaw(ch)); }
+    const uint8_t *data() const { return _payload; }
+
+private:
+    const uint8_t *_payload;
+};
+
+// The channels of one frame, numbered and timestamped, as published by CrsfSerial
+struct CrsfChannelSnapshot
+{
+    uint32_t seq;       // increments for every channels frame, 0 before the first
+    uint32_t arrivalUs; // micros() when the frame passed its crc check
+    uint8_t packed[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+
+    CrsfChannelsView view() const { return CrsfChannelsView(packed); }
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Free running high resolution timestamp for measuring short intervals.
+ * STM32 uses the Cortex-M3 DWT cycle counter, which wraps every 59s at 72MHz.
+ * Other platforms fall back to micros(), on the RP2040 this is its 1MHz timer
+ */
+#if defined(ARDUINO_ARCH_STM32)
+static inline void cycleCountBegin()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+static inline uint32_t cycleCount() { return DWT->CYCCNT; }
+static inline uint32_t cycleCountToUs(uint32_t cycles) { return cycles / (SystemCoreClock / 1000000U); }
+#else
+static inline void cycleCountBegin() {}
+static inline uint32_t cycleCount() { return micros(); }
+static inline uint32_t cycleCountToUs(uint32_t cycles) { return cycles; }
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * DShot ESC protocol frame encoding. A frame is 16 bits sent MSB first:
+ * 11 bit value (0 = disarmed, 1-47 = commands, 48-2047 = throttle),
+ * 1 bit telemetry request, then a 4 bit CRC of the first 12 bits.
+ * Every bit is the same length, a 1 is high for 3/4 of the bit and
+ * a 0 is high for 3/8 of the bit
+ */
+#define DSHOT_FRAME_BITS        16
+#define DSHOT_MOTOR_STOP        0
+#define DSHOT_THROTTLE_MIN      48
+#define DSHOT_THROTTLE_MAX      2047
+
+static inline uint16_t dshotFrame(uint16_t value, bool telemetry)
+{
+    uint16_t packet = (value << 1) | (telemetry ? 1 : 0);
+    uint16_t crc = (packet ^ (packet >> 4) ^ (packet >> 8)) & 0x0f;
+    return (packet << 4) | crc;
+}
+
+// High time of a 0 or 1 bit, in timer ticks given the ticks per bit
+static inline uint16_t dshotBit0Ticks(uint16_t bitTicks) { return bitTicks * 3 / 8; }
+static inline uint16_t dshotBit1Ticks(uint16_t bitTicks) { return bitTicks * 3 / 4; }
+
+/**
+ * Fill the compare values for each bit of frame, MSB first, into dst
+ * every stride entries. Used to interleave several outputs' frames into
+ * one buffer when a DMA burst writes all the compare registers per bit
+ */
+static inline void dshotFrameToTicks(uint16_t frame, uint16_t bit0, uint16_t bit1,
+    uint16_t *dst, unsigned int stride)
+{
+    for (unsigned int bit=0; bit<DSHOT_FRAME_BITS; ++bit)
+    {
+        *dst = (frame & 0x8000) ? bit1 : bit0;
+        frame <<= 1;
+        dst += stride;
+    }
+}
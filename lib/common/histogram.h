@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Histogram of N fixed width buckets, for timing measurements.
+ * Values past the last bucket are counted in the last bucket,
+ * and the largest value added is kept exactly
+ */
+template <uint32_t BUCKET_WIDTH, unsigned int N>
+class Histogram
+{
+public:
+    Histogram() { clear(); }
+
+    void add(uint32_t val)
+    {
+        uint32_t bucket = val / BUCKET_WIDTH;
+        ++_buckets[(bucket < N) ? bucket : N - 1];
+        ++_count;
+        if (val > _max)
+            _max = val;
+    }
+
+    void clear()
+    {
+        memset(_buckets, 0, sizeof(_buckets));
+        _count = 0;
+        _max = 0;
+    }
+
+    /**
+     * Returns the upper edge of the bucket holding the pct percentile,
+     * which is never more than the max
+     */
+    uint32_t percentile(unsigned int pct) const
+    {
+        uint32_t target = (_count * pct + 99) / 100;
+        uint32_t seen = 0;
+        for (unsigned int i=0; i<N; ++i)
+        {
+            seen += _buckets[i];
+            if (seen >= target && seen != 0)
+            {
+                uint32_t upper = (i + 1) * BUCKET_WIDTH;
+                return (i == N - 1 || upper > _max) ? _max : upper;
+            }
+        }
+        return _max;
+    }
+
+    uint32_t getCount() const { return _count; }
+    uint32_t getMax() const { return _max; }
+
+private:
+    uint32_t _buckets[N];
+    uint32_t _count;
+    uint32_t _max;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * SBUS frame: 0x0F header, 16 channels of 11 bits packed LSB first, a flags
+ * byte and a 0x00 footer, sent at 100000 baud 8E2 with inverted levels.
+ * The channel packing and scale (172-1811 = 988-2012us) are exactly the
+ * same as the CRSF RC channels payload, so a CRSF payload is copied as is
+ */
+#define SBUS_BAUD               100000
+#define SBUS_FRAME_SIZE         25
+#define SBUS_CHANNELS_SIZE      22
+#define SBUS_HEADER             0x0f
+#define SBUS_FOOTER             0x00
+
+#define SBUS_FLAG_CH17          (1 << 0)
+#define SBUS_FLAG_CH18          (1 << 1)
+#define SBUS_FLAG_FRAME_LOST    (1 << 2)
+#define SBUS_FLAG_FAILSAFE      (1 << 3)
+
+static inline void sbusBuildFrame(uint8_t *frame, const uint8_t *channelsPacked, uint8_t flags)
+{
+    frame[0] = SBUS_HEADER;
+    memcpy(&frame[1], channelsPacked, SBUS_CHANNELS_SIZE);
+    frame[SBUS_FRAME_SIZE - 2] = flags;
+    frame[SBUS_FRAME_SIZE - 1] = SBUS_FOOTER;
+}
+
+// The packed channels of a frame, or nullptr if the header or footer is wrong
+static inline const uint8_t *sbusFrameChannels(const uint8_t *frame)
+{
+    if (frame[0] != SBUS_HEADER || frame[SBUS_FRAME_SIZE - 1] != SBUS_FOOTER)
+        return nullptr;
+    return &frame[1];
+}
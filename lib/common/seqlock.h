@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Sequence lock around a value with one writer and any number of readers.
+ * The writer never waits, readers copy the value and retry if a write
+ * happened during the copy, so neither side disables interrupts.
+ * A reader must not preempt the writer (e.g. read from a higher priority
+ * interrupt than the one writing) or it would retry forever, use tryRead()
+ * there instead
+ */
+template <typename T>
+class SeqLock
+{
+public:
+    SeqLock() : _seq(0), _data() {}
+
+    // Start a write, modify the value in place then call endWrite()
+    T &beginWrite()
+    {
+        ++_seq;
+        __sync_synchronize();
+        return _data;
+    }
+
+    void endWrite()
+    {
+        __sync_synchronize();
+        ++_seq;
+    }
+
+    void write(const T &val)
+    {
+        beginWrite() = val;
+        endWrite();
+    }
+
+    // Copy the value into out if no write is in progress, returns false if it was
+    bool tryRead(T &out) const
+    {
+        uint32_t seq = _seq;
+        if (seq & 1)
+            return false;
+        __sync_synchronize();
+        out = _data;
+        __sync_synchronize();
+        return seq == _seq;
+    }
+
+    void read(T &out) const
+    {
+        while (!tryRead(out))
+            ;
+    }
+
+private:
+    volatile uint32_t _seq; // odd while a write is in progress
+    T _data;
+};
@@ -1,14 +1,110 @@
-#pragma once
-
-#include <stdint.h>
-
-class Crc8
-{
-public:
-    Crc8(uint8_t poly);
-    uint8_t calc(uint8_t *data, uint8_t len);
-
-protected:
-    uint8_t _lut[256];
-    void init(uint8_t poly);
-};
\ No newline at end of file
+#pragma once
+
+#include <stdint.h>
+
+template <uint8_t POLY>
+struct Crc8Lut
+{
+    uint8_t table[256];
+
+    constexpr Crc8Lut() : table()
+    {
+        for (unsigned int idx=0; idx<256; ++idx)
+        {
+            uint8_t crc = idx;
+            for (unsigned int shift=0; shift<8; ++shift)
+            {
+                crc = (crc << 1) ^ ((crc & 0x80) ? POLY : 0);
+            }
+            table[idx] = crc;
+        }
+    }
+};
+
+/**
+ * The crc of each single bit followed by n zero bytes, for n below LEN. The crc
+ * is linear in the data, so this is a byte's contribution to a running crc
+ */
+template <uint8_t POLY, unsigned int LEN>
+struct Crc8ShiftLut
+{
+    uint8_t table[LEN][8];
+
+    constexpr Crc8ShiftLut() : table()
+    {
+        constexpr Crc8Lut<POLY> lut = Crc8Lut<POLY>();
+        for (unsigned int bit=0; bit<8; ++bit)
+        {
+            uint8_t crc = lut.table[1 << bit];
+            for (unsigned int n=0; n<LEN; ++n)
+            {
+                table[n][bit] = crc;
+                crc = lut.table[crc];
+            }
+        }
+    }
+};
+
+// Reverses one step of Crc8Lut, only possible if POLY has its lowest bit set
+template <uint8_t POLY>
+struct Crc8InvLut
+{
+    static_assert(POLY & 1, "CRC8 step is not reversible for an even POLY");
+    uint8_t table[256];
+
+    constexpr Crc8InvLut() : table()
+    {
+        constexpr Crc8Lut<POLY> lut = Crc8Lut<POLY>();
+        for (unsigned int idx=0; idx<256; ++idx)
+        {
+            table[lut.table[idx]] = idx;
+        }
+    }
+};
+
+/**
+ * CRC8 with a lookup table generated at compile time. The table is const
+ * so it lives in flash, and is shared by everything using the same POLY
+ */
+template <uint8_t POLY>
+class Crc8
+{
+public:
+    static uint8_t calc(const uint8_t *data, uint8_t len)
+    {
+        uint8_t crc = 0;
+        while (len--)
+        {
+            crc = _lut.table[crc ^ *data++];
+        }
+        return crc;
+    }
+
+    // Fold a single byte into a running crc, start with crc = 0
+    static uint8_t update(uint8_t crc, uint8_t data) { return _lut.table[crc ^ data]; }
+
+    // Take the first byte back out of a running crc which has had followCnt (below 64) bytes folded in after it
+    static uint8_t removeFirst(uint8_t crc, uint8_t first, uint8_t followCnt)
+    {
+        static constexpr Crc8ShiftLut<POLY, 64> shift = Crc8ShiftLut<POLY, 64>();
+        for (unsigned int bit=0; first; ++bit, first >>= 1)
+        {
+            if (first & 1)
+                crc ^= shift.table[followCnt][bit];
+        }
+        return crc;
+    }
+
+    // Take the last byte folded in back out of a running crc
+    static uint8_t removeLast(uint8_t crc, uint8_t last)
+    {
+        static constexpr Crc8InvLut<POLY> inv = Crc8InvLut<POLY>();
+        return inv.table[crc] ^ last;
+    }
+
+protected:
+    static constexpr Crc8Lut<POLY> _lut = Crc8Lut<POLY>();
+};
+
+template <uint8_t POLY>
+constexpr Crc8Lut<POLY> Crc8<POLY>::_lut;
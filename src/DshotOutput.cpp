@@ -0,0 +1,139 @@
+#include "DshotOutput.h"
+
+#if defined(ARDUINO_ARCH_STM32)
+
+#include <dshot.h>
+#include "ServoTimer.h"
+
+// One extra bit with compare 0 so the line stays low after the frame
+#define DSHOT_BUF_BITS      (DSHOT_FRAME_BITS + 1)
+#define DSHOT_TIM_CHANNELS  4
+
+// State shared by all the DShot outputs on each timer instance
+struct tagDshotTimer {
+    TIM_TypeDef *instance;
+    HardwareTimer *timer;
+    DMA_Channel_TypeDef *dma;
+    uint8_t dmaChannel;
+    uint8_t activeMask;
+    uint16_t bit0;
+    uint16_t bit1;
+    uint16_t frames[DSHOT_TIM_CHANNELS];
+    // Compare values for CCR1-CCR4 for each bit, in DMA burst order
+    uint16_t buf[DSHOT_BUF_BITS * DSHOT_TIM_CHANNELS];
+};
+static tagDshotTimer g_DshotTimers[4];
+
+static tagDshotTimer *getDshotTimer(TIM_TypeDef *instance, uint32_t kbps)
+{
+    for (auto &dt : g_DshotTimers)
+    {
+        if (dt.instance == instance)
+            return &dt;
+
+        if (dt.instance == nullptr)
+        {
+            // First use of this timer, claim its update DMA channel unless something else has
+            DMA_Channel_TypeDef *dma = servoTimerUpdateDma(instance, &dt.dmaChannel);
+            if (dma == nullptr || (dma->CCR & DMA_CCR_EN))
+                return nullptr;
+
+            HardwareTimer *ht = new HardwareTimer(instance);
+            uint32_t bitTicks = ht->getTimerClkFreq() / (kbps * 1000U);
+            ht->setPrescaleFactor(1);
+            ht->setOverflow(bitTicks, TICK_FORMAT);
+            instance->CR1 |= TIM_CR1_ARPE;
+            // Each update event bursts 4 transfers through DMAR into CCR1-CCR4
+            instance->DCR = ((DSHOT_TIM_CHANNELS - 1) << TIM_DCR_DBL_Pos) |
+                ((uint32_t)(&instance->CCR1 - &instance->CR1) << TIM_DCR_DBA_Pos);
+            instance->DIER |= TIM_DIER_UDE;
+
+            __HAL_RCC_DMA1_CLK_ENABLE();
+            dma->CCR = 0;
+            dma->CPAR = (uint32_t)&instance->DMAR;
+            dma->CMAR = (uint32_t)dt.buf;
+            dma->CNDTR = 0;
+            dma->CCR = DMA_CCR_PL_1 | DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_DIR;
+
+            dt.bit0 = dshotBit0Ticks(bitTicks);
+            dt.bit1 = dshotBit1Ticks(bitTicks);
+            dt.timer = ht;
+            dt.dma = dma;
+            dt.instance = instance;
+            return &dt;
+        }
+    }
+
+    return nullptr;
+}
+
+bool DshotOutput::begin(PinName pin, uint32_t kbps)
+{
+    if (_timer)
+        return true;
+
+    TIM_TypeDef *instance = (TIM_TypeDef *)pinmap_peripheral(pin, PinMap_PWM);
+    tagDshotTimer *dt = getDshotTimer(instance, kbps);
+    if (dt == nullptr)
+        return false;
+
+    HardwareTimer *ht = dt->timer;
+    uint32_t channel = STM_PIN_CHANNEL(pinmap_function(pin, PinMap_PWM));
+    ht->setMode(channel, TIMER_OUTPUT_COMPARE_PWM1, pin);
+    ht->setCaptureCompare(channel, 0, TICK_COMPARE_FORMAT);
+    // Compare preload so each bit's value is latched at the start of the bit
+    if (channel <= 2)
+        instance->CCMR1 |= (channel == 1) ? TIM_CCMR1_OC1PE : TIM_CCMR1_OC2PE;
+    else
+        instance->CCMR2 |= (channel == 3) ? TIM_CCMR2_OC3PE : TIM_CCMR2_OC4PE;
+    ht->resume();
+
+    _timer = dt;
+    _channel = channel - 1;
+    return true;
+}
+
+void DshotOutput::set(uint16_t value)
+{
+    _timer->frames[_channel] = dshotFrame(value, false);
+    _timer->activeMask |= 1 << _channel;
+}
+
+void DshotOutput::end()
+{
+    _timer->activeMask &= ~(1 << _channel);
+}
+
+/***
+ * @brief: Fill each DShot timer's bit buffer from its outputs' frames and
+ *         restart its DMA, which outputs the frame over the next 16 bit periods
+ * @details: A timer which has not finished the last frame is skipped, so frames
+ *           are never cut short if called faster than the frame length
+ */
+void DshotOutput::sendAll()
+{
+    for (auto &dt : g_DshotTimers)
+    {
+        if (dt.instance == nullptr)
+            break;
+
+        if (dt.activeMask == 0 || dt.dma->CNDTR != 0)
+            continue;
+
+        for (unsigned int ch=0; ch<DSHOT_TIM_CHANNELS; ++ch)
+        {
+            if (dt.activeMask & (1 << ch))
+                dshotFrameToTicks(dt.frames[ch], dt.bit0, dt.bit1, &dt.buf[ch], DSHOT_TIM_CHANNELS);
+            else
+                dshotFrameToTicks(0, 0, 0, &dt.buf[ch], DSHOT_TIM_CHANNELS);
+        }
+        // The final bit is always left 0 from startup
+
+        dt.dma->CCR &= ~DMA_CCR_EN;
+        DMA1->IFCR = DMA_IFCR_CGIF1 << ((dt.dmaChannel - 1) * 4);
+        dt.dma->CNDTR = DSHOT_BUF_BITS * DSHOT_TIM_CHANNELS;
+        dt.dma->CCR |= DMA_CCR_EN;
+    }
+}
+
+#endif
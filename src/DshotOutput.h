@@ -0,0 +1,41 @@
+#pragma once
+
+#if defined(ARDUINO_ARCH_STM32)
+
+#include <Arduino.h>
+
+struct tagDshotTimer;
+
+/**
+ * DShot ESC output generated by a timer, with a DMA burst on each timer
+ * update writing the next bit's compare value to all 4 channels at once.
+ * All outputs on a timer send their frames together, so sending a frame
+ * costs the same CPU time however many outputs there are: filling one
+ * 64 entry buffer and restarting the DMA channel, no interrupts.
+ * Every output on a timer must use DShot at the same bitrate, and the
+ * timer's update DMA channel (TIM1 ch5, TIM2 ch2, TIM3 ch3, TIM4 ch7)
+ * must not be used by anything else, such as CRSF receive DMA (STM32F1
+ * DMA1 request mapping).
+ */
+class DshotOutput
+{
+public:
+    DshotOutput() : _timer(nullptr), _channel(0) {}
+
+    // Configure pin's timer for DShot at kbps (150, 300, 600), returns false if the DMA is in use
+    bool begin(PinName pin, uint32_t kbps);
+    // Value sent in following frames, 0 to disarm or 48-2047 throttle
+    void set(uint16_t value);
+    // Stop sending frames, the pin stays driven low
+    void end();
+    bool isStarted() const { return _timer != nullptr; }
+
+    // Start sending a frame on every DShot timer, skipping any still sending the last one
+    static void sendAll();
+
+private:
+    tagDshotTimer *_timer;
+    uint8_t _channel;
+};
+
+#endif
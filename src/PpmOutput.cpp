@@ -0,0 +1,91 @@
+#include "PpmOutput.h"
+
+#if defined(ARDUINO_ARCH_STM32)
+
+#include "ServoTimer.h"
+
+// 0.625us tick, which is the CRSF channel resolution
+#define PPM_Q3_PER_TICK     5
+#define PPM_US_TO_TICKS(us) (((us) << SERVO_US_Q3_SHIFT) / PPM_Q3_PER_TICK)
+
+bool PpmOutput::begin(PinName pin, unsigned int channelCnt)
+{
+    if (_timer)
+        return true;
+
+    TIM_TypeDef *instance = (TIM_TypeDef *)pinmap_peripheral(pin, PinMap_PWM);
+    uint8_t dmaChannel;
+    DMA_Channel_TypeDef *dma = servoTimerUpdateDma(instance, &dmaChannel);
+    if (dma == nullptr || (dma->CCR & DMA_CCR_EN))
+        return false;
+
+    _channelCnt = min(channelCnt, (unsigned int)PPM_MAX_CHANNELS);
+    for (unsigned int ch=0; ch<_channelCnt; ++ch)
+        _periods[ch] = PPM_US_TO_TICKS(1500) - 1;
+    commit();
+
+    HardwareTimer *ht = new HardwareTimer(instance);
+    ht->setPrescaleFactor(ht->getTimerClkFreq() / (1000000U << SERVO_US_Q3_SHIFT) * PPM_Q3_PER_TICK);
+    ht->setOverflow(PPM_US_TO_TICKS(PPM_MIN_SYNC_US), TICK_FORMAT);
+    instance->CR1 |= TIM_CR1_ARPE;
+    uint32_t channel = STM_PIN_CHANNEL(pinmap_function(pin, PinMap_PWM));
+    ht->setMode(channel, TIMER_OUTPUT_COMPARE_PWM1, pin);
+    // No pulse until start(), which sets the preloaded compare so the first pulse is a whole one
+    ht->setCaptureCompare(channel, 0, TICK_COMPARE_FORMAT);
+    if (channel <= 2)
+        instance->CCMR1 |= (channel == 1) ? TIM_CCMR1_OC1PE : TIM_CCMR1_OC2PE;
+    else
+        instance->CCMR2 |= (channel == 3) ? TIM_CCMR2_OC3PE : TIM_CCMR2_OC4PE;
+
+    // Each update event loads the next period into the auto-reload preload, enabled by start()
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    dma->CCR = 0;
+    dma->CPAR = (uint32_t)&instance->ARR;
+    dma->CMAR = (uint32_t)_periods;
+    dma->CNDTR = _channelCnt + 1;
+    dma->CCR = DMA_CCR_PL_1 | DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR;
+    ht->resume();
+
+    _timer = ht;
+    _instance = instance;
+    _dma = dma;
+    _dmaChannel = dmaChannel;
+    // CCR1-CCR4 are consecutive registers
+    _ccr = &instance->CCR1 + (channel - 1);
+    return true;
+}
+
+void PpmOutput::start()
+{
+    if (_dma == nullptr || (_dma->CCR & DMA_CCR_EN))
+        return;
+
+    // The period running now is the sync gap, the DMA loads the first channel's
+    // period at its end, so the values set before start() are always the first out
+    DMA1->IFCR = DMA_IFCR_CGIF1 << ((_dmaChannel - 1) * 4);
+    _dma->CCR |= DMA_CCR_EN;
+    _instance->DIER |= TIM_DIER_UDE;
+    *_ccr = PPM_US_TO_TICKS(PPM_PULSE_US);
+}
+
+void PpmOutput::set(unsigned int ch, uint32_t usQ3)
+{
+    if (ch >= _channelCnt)
+        return;
+    // The pulse must fit in the period
+    usQ3 = constrain(usQ3, (uint32_t)(PPM_PULSE_US * 2) << SERVO_US_Q3_SHIFT, (uint32_t)2500 << SERVO_US_Q3_SHIFT);
+    _periods[ch] = usQ3 / PPM_Q3_PER_TICK - 1;
+}
+
+void PpmOutput::commit()
+{
+    uint32_t total = 0;
+    for (unsigned int ch=0; ch<_channelCnt; ++ch)
+        total += _periods[ch] + 1;
+
+    uint32_t sync = PPM_US_TO_TICKS(PPM_FRAME_US);
+    sync = (total + PPM_US_TO_TICKS(PPM_MIN_SYNC_US) > sync) ? PPM_US_TO_TICKS(PPM_MIN_SYNC_US) : sync - total;
+    _periods[_channelCnt] = sync - 1;
+}
+
+#endif
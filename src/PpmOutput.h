@@ -0,0 +1,50 @@
+#pragma once
+
+#if defined(ARDUINO_ARCH_STM32)
+
+#include <Arduino.h>
+
+#define PPM_MAX_CHANNELS    12
+#define PPM_FRAME_US        22500
+#define PPM_PULSE_US        300
+#define PPM_MIN_SYNC_US     4000
+
+/**
+ * PPM train output generated by a timer in PWM mode, with a circular DMA
+ * on the timer update writing each channel's period into the preloaded
+ * auto-reload register. Every period starts with a PPM_PULSE_US high pulse
+ * and the time between pulses is the channel value, followed by a sync
+ * gap filling out the PPM_FRAME_US frame. The train runs with no interrupts,
+ * begin() does all the setup, start() and set() are only register and
+ * memory writes so they can be called from an interrupt.
+ * The timer must not be used by any other output, and its update DMA
+ * channel must not be in use (see servoTimerUpdateDma()).
+ */
+class PpmOutput
+{
+public:
+    PpmOutput() : _timer(nullptr), _instance(nullptr), _dma(nullptr), _ccr(nullptr), _dmaChannel(0), _channelCnt(0) {}
+
+    // Set up the train on pin with channelCnt channels at 1500us, the pin stays low until start().
+    // Returns false if the DMA is in use
+    bool begin(PinName pin, unsigned int channelCnt);
+    // Start the train if begin() succeeded and it is not already running, a sync gap comes first
+    void start();
+    // Set channel (0-based) in 1/8us units, call commit() after setting all the channels
+    void set(unsigned int ch, uint32_t usQ3);
+    // Recalculate the sync gap so the frame stays the same length
+    void commit();
+    bool isStarted() const { return _timer != nullptr; }
+
+private:
+    HardwareTimer *_timer;
+    TIM_TypeDef *_instance;
+    DMA_Channel_TypeDef *_dma;
+    volatile uint32_t *_ccr;
+    uint8_t _dmaChannel;
+    unsigned int _channelCnt;
+    // Auto-reload value for each channel then the sync gap
+    uint16_t _periods[PPM_MAX_CHANNELS + 1];
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "ServoTimer.h"
+
+#if defined(ARDUINO_ARCH_STM32)
+
+// One HardwareTimer shared by all the outputs on each timer instance
+static struct tagSharedTimer {
+    TIM_TypeDef *instance;
+    HardwareTimer *timer;
+    uint32_t q3PerTick;
+} g_SharedTimers[4];
+
+static tagSharedTimer *getSharedTimer(TIM_TypeDef *instance, uint32_t freqHz)
+{
+    for (auto &st : g_SharedTimers)
+    {
+        if (st.instance == instance)
+            return &st;
+
+        if (st.instance == nullptr)
+        {
+            // First use of this timer. Use the finest tick which fits the period in 16 bits,
+            // out of 1/8us (every Q3 value), 0.625us (every CRSF step) or 1us
+            uint32_t periodQ3 = (1000000U << SERVO_US_Q3_SHIFT) / freqHz;
+            if (periodQ3 <= 0x10000)
+                st.q3PerTick = 1;
+            else if (periodQ3 <= 0x10000 * 5)
+                st.q3PerTick = 5;
+            else
+                st.q3PerTick = 8;
+
+            HardwareTimer *ht = new HardwareTimer(instance);
+            ht->setPrescaleFactor(ht->getTimerClkFreq() / (1000000U << SERVO_US_Q3_SHIFT) * st.q3PerTick);
+            ht->setOverflow(periodQ3 / st.q3PerTick, TICK_FORMAT);
+            instance->CR1 |= TIM_CR1_ARPE;
+            st.instance = instance;
+            st.timer = ht;
+            return &st;
+        }
+    }
+
+    return nullptr;
+}
+
+// Fixed DMA1 request mapping for TIMx_UP on STM32F1
+DMA_Channel_TypeDef *servoTimerUpdateDma(TIM_TypeDef *instance, uint8_t *channel)
+{
+    if (instance == TIM1)
+    {
+        *channel = 5;
+        return DMA1_Channel5;
+    }
+    if (instance == TIM2)
+    {
+        *channel = 2;
+        return DMA1_Channel2;
+    }
+    if (instance == TIM3)
+    {
+        *channel = 3;
+        return DMA1_Channel3;
+    }
+    if (instance == TIM4)
+    {
+        *channel = 7;
+        return DMA1_Channel7;
+    }
+    return nullptr;
+}
+
+void ServoTimer::begin(PinName pin, uint32_t freqHz)
+{
+    if (_ccr)
+        return;
+
+    TIM_TypeDef *instance = (TIM_TypeDef *)pinmap_peripheral(pin, PinMap_PWM);
+    tagSharedTimer *st = getSharedTimer(instance, freqHz);
+    if (st == nullptr)
+        return;
+
+    HardwareTimer *ht = st->timer;
+    uint32_t channel = STM_PIN_CHANNEL(pinmap_function(pin, PinMap_PWM));
+    ht->setMode(channel, TIMER_OUTPUT_COMPARE_PWM1, pin);
+    ht->setCaptureCompare(channel, 0, TICK_COMPARE_FORMAT);
+    // Compare preload so new values are only latched on the update event
+    if (channel <= 2)
+        instance->CCMR1 |= (channel == 1) ? TIM_CCMR1_OC1PE : TIM_CCMR1_OC2PE;
+    else
+        instance->CCMR2 |= (channel == 3) ? TIM_CCMR2_OC3PE : TIM_CCMR2_OC4PE;
+    ht->resume();
+
+    // CCR1-CCR4 are consecutive registers
+    _ccr = &instance->CCR1 + (channel - 1);
+    // Rounded up so the divide by 5 stays exact after the shift
+    _tickMul = ((1U << SERVO_TICK_MUL_SHIFT) + st->q3PerTick - 1) / st->q3PerTick;
+}
+
+/***
+ * @brief: Start a new PWM period on every timer which has already run for at
+ *         least minPeriodUs, so values just set are output immediately instead
+ *         of at the end of the free running period
+ * @details: minPeriodUs must be longer than any pulse, so a pulse is never cut
+ *           short. Pass 0 to never restart and just measure
+ * @return: The longest time in us until the next pulse starts on any timer
+ */
+uint32_t ServoTimer::syncPeriod(uint32_t minPeriodUs)
+{
+    uint32_t maxWait = 0;
+    for (auto &st : g_SharedTimers)
+    {
+        if (st.instance == nullptr)
+            break;
+
+        uint32_t cnt = st.instance->CNT;
+        if (minPeriodUs != 0 && cnt >= (minPeriodUs << SERVO_US_Q3_SHIFT) / st.q3PerTick)
+        {
+            // Update event resets the counter and latches the preloaded compare values
+            st.instance->EGR = TIM_EGR_UG;
+            continue;
+        }
+
+        uint32_t wait = ((st.instance->ARR + 1 - cnt) * st.q3PerTick) >> SERVO_US_Q3_SHIFT;
+        if (wait > maxWait)
+            maxWait = wait;
+    }
+
+    return maxWait;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#if defined(ARDUINO_ARCH_STM32)
+
+#include <Arduino.h>
+
+#define SERVO_US_Q3_SHIFT   3
+// ticks = usQ3 * mul >> SERVO_TICK_MUL_SHIFT replaces the divide by the Q3 values
+// per tick, exact for usQ3 below 2^22 (over 500ms) with every tick size
+#define SERVO_TICK_MUL_SHIFT    22
+
+/**
+ * Timer number (1-4) which generates PWM on pin, following the first match for
+ * the pin in the STM32F103 core's PinMap_PWM, or 0 if the pin has no timer.
+ * Used to check at compile time which outputs share a timer
+ */
+static constexpr unsigned int servoTimerForPin(PinName pin)
+{
+    return ((pin >= PA_0 && pin <= PA_3) || pin == PA_15 || pin == PB_3 || pin == PB_10 || pin == PB_11) ? 2 :
+        (pin == PA_6 || pin == PA_7 || pin == PB_0 || pin == PB_1 || pin == PB_4 || pin == PB_5) ? 3 :
+        (pin >= PB_6 && pin <= PB_9) ? 4 :
+        (pin >= PA_8 && pin <= PA_11) ? 1 :
+        0;
+}
+
+// DMA1 channel requested by the timer's update event, and its channel number (STM32F1 mapping)
+DMA_Channel_TypeDef *servoTimerUpdateDma(TIM_TypeDef *instance, uint8_t *channel);
+
+/**
+ * Servo PWM output written directly to a timer compare register.
+ * The timer and channel are configured once in begin(), after which
+ * changing the pulse width is a single register write. The compare
+ * register is preloaded, so a new value takes effect at the start of
+ * the next PWM period and never cuts off a pulse in progress.
+ * Outputs on the same timer share its period, the first begin() on a
+ * timer sets it. Pulse widths are in 1/8us (Q3) units, the timer tick is
+ * 1/8us, 5/8us or 1us depending on which fits the period, which limits
+ * freqHz to 16Hz and up.
+ */
+class ServoTimer
+{
+public:
+    ServoTimer() : _ccr(nullptr), _tickMul(0) {}
+
+    // Configure pin's timer channel for PWM at freqHz, output stays low until set()
+    void begin(PinName pin, uint32_t freqHz);
+    // Ignored if begin() failed
+    void set(uint32_t usQ3)
+    {
+        if (_ccr)
+            *_ccr = ((uint64_t)usQ3 * _tickMul) >> SERVO_TICK_MUL_SHIFT;
+    }
+    // Stop pulses after the current period, the pin stays driven low
+    void end() { *_ccr = 0; }
+    bool isStarted() const { return _ccr != nullptr; }
+
+    static uint32_t syncPeriod(uint32_t minPeriodUs);
+
+private:
+    volatile uint32_t *_ccr;
+    uint32_t _tickMul;
+};
+
+#endif
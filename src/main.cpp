@@ -1,422 +1,923 @@
-#include <Arduino.h>
-#include <CrsfSerial.h>
-#include <median.h>
-#include "target.h"
-
-#define NUM_OUTPUTS 8
-
-// Configuration
-// Map input CRSF channels (1-based, up to 16 for CRSF, 12 for ELRS) to outputs 1-8
-// use a negative number to invert the signal (i.e. +100% becomes -100%)
-constexpr int OUTPUT_MAP[NUM_OUTPUTS] = { 1, 2, 3, 4, 6, 7, 8, 12 };
-// The failsafe action for each channel (fsaNoPulses, fsaHold, or microseconds)
-constexpr int OUTPUT_FAILSAFE[NUM_OUTPUTS] = {
-    1500, 1500, 988, 1500,                  // ch1-ch4
-    fsaHold, fsaHold, fsaHold, fsaNoPulses  // ch5-ch8
-    };
-// Define the pins used to output servo PWM, must use hardware PWM,
-// and change HardwareTimer targets below if the timers change
-constexpr PinName OUTPUT_PINS[NUM_OUTPUTS] = { OUTPUT_PIN_MAP };
-
-#define PWM_FREQ_HZ     50
-#define VBAT_INTERVAL   500
-#define VBAT_SMOOTH     5
-// Scale used to calibrate or change to CRSF standard 0.1 scale
-#define VBAT_SCALE      1.0
-
-// Optimal safety and performance: Arm switch on AUX1 (channel 5)
-// It is not recommended to change the channel
-// See https://www.expresslrs.org/software/switch-config/
-// Only used if USE_ARMSWITCH defined
-#define ELRS_ARM_CHANNEL 5
-
-// Local Variables
-#if defined(ARDUINO_ARCH_STM32)
-static HardwareSerial CrsfSerialStream(USART_INPUT);
-#elif defined(TARGET_RASPBERRY_PI_PICO)
-static UART CrsfSerialStream(DPIN_CRSF_TX, DPIN_CRSF_RX);
-#endif
-static CrsfSerial crsf(CrsfSerialStream);
-static int g_OutputsUs[NUM_OUTPUTS];
-#if defined(TARGET_RASPBERRY_PI_PICO)
-#include <Servo.h>
-static Servo *g_Servos[NUM_OUTPUTS];
-#endif
-static struct tagConnectionState {
-    uint32_t lastVbatRead;
-    MedianAvgFilter<unsigned int, VBAT_SMOOTH>vbatSmooth;
-    unsigned int vbatValue;
-
-    char serialInBuff[64];
-    uint8_t serialInBuffLen;
-    bool serialEcho;
-} g_State;
-
-static void crsfOobData(uint8_t b)
-{
-    // A shifty byte is usually just log messages from ELRS
-    Serial.write(b);
-}
-
-/**
- * @brief: Initialize a servo pin output for the first time
-*/
-static void servoPlatformBegin(unsigned int servo)
-{
-#if defined(ARDUINO_ARCH_STM32)
-    // vv pinMode(p, OUTPUT) vv
-    pin_function(OUTPUT_PINS[servo], STM_PIN_DATA(STM_MODE_OUTPUT_PP, GPIO_NOPULL, 0));
-#endif
-#if defined(TARGET_RASPBERRY_PI_PICO)
-    // Pi Pico waits for the value before attaching the servo
-    Servo *s = new Servo();
-    s->attach(OUTPUT_PINS[servo], CRSF_ELIMIT_US_MIN, CRSF_ELIMIT_US_MAX);
-    g_Servos[servo] = s;
-#endif
-}
-
-/**
- * @brief: Set an already initialized servo to a usec value
-*/
-static void servoPlatformSet(unsigned int servo, int usec)
-{
-#if defined(ARDUINO_ARCH_STM32)
-    pwm_start(OUTPUT_PINS[servo], PWM_FREQ_HZ, usec, MICROSEC_COMPARE_FORMAT);
-#endif
-#if defined(TARGET_RASPBERRY_PI_PICO)
-    if (g_Servos[servo] == nullptr)
-    {
-        Servo *s = new Servo();
-        s->attach(OUTPUT_PINS[servo], CRSF_ELIMIT_US_MIN, CRSF_ELIMIT_US_MAX, usec);
-        g_Servos[servo] = s;
-    }
-    else
-        g_Servos[servo]->writeMicroseconds(usec);
-#endif
-}
-
-static void servoPlatformEnd(unsigned int servo)
-{
-#if defined(PLATFORM_STM32)
-    pwm_stop(OUTPUT_PINS[servo]);
-    // vv pinMode(p, INPUT_PULLDOWN) vv
-    pin_function(OUTPUT_PINS[servo], STM_PIN_DATA(STM_MODE_INPUT, GPIO_PULLDOWN, 0));
-#endif
-#if defined(TARGET_RASPBERRY_PI_PICO)
-     Servo *s = g_Servos[servo];
-     g_Servos[servo] = nullptr;
-     s->detach();
-     delete s;
-#endif
-}
-
-static void servoSetUs(unsigned int servo, int usec)
-{
-    if (usec > 0)
-    {
-        // 0 means it was disabled previously, enable OUTPUT mode
-        if (g_OutputsUs[servo] == 0)
-            servoPlatformBegin(servo);
-        servoPlatformSet(servo, usec);
-    }
-    else
-    {
-        servoPlatformEnd(servo);
-    }
-    g_OutputsUs[servo] = usec;
-}
-
-
-static void outputFailsafeValues()
- {
-    for (unsigned int out=0; out<NUM_OUTPUTS; ++out)
-    {
-        if (OUTPUT_FAILSAFE[out] == fsaNoPulses)
-            servoSetUs(out, 0);
-        else if (OUTPUT_FAILSAFE[out] != fsaHold)
-            servoSetUs(out, OUTPUT_FAILSAFE[out]);
-        // else fsaHold does nothing, keep the same value
-    }
-}
-
-
-#if defined(USE_ARMSWITCH)
-// If USE_ARMSWITCH flag is given during compilation, isArmed
-// checks if the arm signal was sent on channel defined by CRSF_ELRS_ARM_CHANNEL.
-// The arm signal has to be *over* 1500us
-static bool isArmed()
-{
-    // Static variable to store arm count, initialized to 0
-    static uint8_t armCount = 0;
-
-    if (crsf.getChannel(ELRS_ARM_CHANNEL) <= 1500)
-    {
-        armCount = 0;
-        return false;
-    }
-    // Require at least 4 packets with "arm" signal, in order to
-    // prevent accidental arming due to corrupt signals, similar
-    // to Betaflight
-    if (armCount < 4)
-    {
-        armCount++;
-        return false;
-    }
-    return true;
-}
-#endif
-
-static void packetChannels()
-{
-#if defined(USE_ARMSWITCH)
-    if (!isArmed())
-    {
-        outputFailsafeValues();
-        return;
-    }
-#endif
-
-    for (unsigned int out=0; out<NUM_OUTPUTS; ++out)
-    {
-        const int chInput = OUTPUT_MAP[out];
-        int usOutput;
-        if (chInput > 0)
-            usOutput = crsf.getChannel(chInput);
-        else
-        {
-            // if chInput is negative, invert the channel output
-            usOutput = crsf.getChannel(-chInput);
-            // (1500 - usOutput) + 1500
-            usOutput = 3000 - usOutput;
-        }
-        servoSetUs(out, usOutput);
-    }
-
-    // for (unsigned int ch=1; ch<=4; ++ch)
-    // {
-    //     Serial.write(ch < 10 ? '0' + ch : 'A' + ch - 10);
-    //     Serial.write('=');
-    //     Serial.print(crsf.getChannel(ch), DEC);
-    //     Serial.write(' ');
-    // }
-    // Serial.println();
-}
-
-static void packetLinkStatistics(crsfLinkStatistics_t *link)
-{
-  //Serial.print(link->uplink_RSSI_1, DEC);
-  //Serial.println("dBm");
-}
-
-static void crsfLinkUp()
-{
-    digitalWrite(DPIN_LED, HIGH ^ LED_INVERTED);
-}
-
-static void crsfLinkDown()
-{
-    digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
-    outputFailsafeValues();
- }
-
-static void checkVbatt()
-{
-#if defined(APIN_VBAT)
-    if (millis() - g_State.lastVbatRead < (VBAT_INTERVAL / VBAT_SMOOTH))
-        return;
-    g_State.lastVbatRead = millis();
-
-    unsigned int idx = g_State.vbatSmooth.add(analogRead(APIN_VBAT));
-    if (idx != 0)
-        return;
-
-    unsigned int adc = g_State.vbatSmooth;
-    g_State.vbatValue = 330U * adc * (VBAT_R1 + VBAT_R2) / VBAT_R2 / ((1 << 12) - 1);
-
-    crsf_sensor_battery_t crsfbatt = { 0 };
-    uint16_t scaledVoltage = g_State.vbatValue * VBAT_SCALE;
-    // Values are MSB first (BigEndian)
-    crsfbatt.voltage = htobe16(scaledVoltage);
-    crsf.queuePacket(CRSF_FRAMETYPE_BATTERY_SENSOR, &crsfbatt, sizeof(crsfbatt));
-
-    //Serial.print("ADC="); Serial.print(adc, DEC);
-    //Serial.print(" "); Serial.print(g_State.vbatValue, DEC); Serial.println("V");
-#endif // APIN_VBAT
-}
-
-static void passthroughBegin(uint32_t baud)
-{
-    if (baud != crsf.getBaud())
-    {
-        // Force a reboot command since we want to send the reboot
-        // at 420000 then switch to what the user wanted
-        const uint8_t rebootpayload[] = { 'b', 'l' };
-        crsf.queuePacket(CRSF_FRAMETYPE_COMMAND, &rebootpayload, sizeof(rebootpayload));
-    }
-
-    crsf.setPassthroughMode(true, baud);
-    g_State.serialEcho = false;
-}
-
-/***
- * @brief Processes a text command like we're some sort of CLI or something
- * @return true if CrsfSerial was placed into passthrough mode, false otherwise
-*/
-static bool handleSerialCommand(char *cmd)
-{
-    // Fake a CRSF RX on UART6
-    bool prompt = true;
-    if (strcmp(cmd, "#") == 0)
-    {
-        Serial.println("Fake CLI Mode, type 'exit' or 'help' to do nothing\r\n");
-        g_State.serialEcho = true;
-    }
-
-    else if (strcmp(cmd, "serial") == 0)
-        Serial.println("serial 5 64 0 0 0 0\r\n");
-
-    else if (strcmp(cmd, "get serialrx_provider") == 0)
-        Serial.println("serialrx_provider = CRSF\r\n");
-
-    else if (strcmp(cmd, "get serialrx_inverted") == 0)
-        Serial.println("serialrx_inverted = OFF\r\n");
-
-    else if (strcmp(cmd, "get serialrx_halfduplex") == 0)
-        Serial.println("serialrx_halfduplex = OFF\r\n");
-
-    else if (strncmp(cmd, "serialpassthrough 5 ", 20) == 0)
-    {
-        // Just echo the command back, BF and iNav both send
-        // difference blocks of text as they start passthrough
-        Serial.println(cmd);
-
-        unsigned int baud = atoi(&cmd[20]);
-        passthroughBegin(baud);
-
-        return true;
-    }
-
-    else
-        prompt = false;
-
-    if (prompt)
-        Serial.print("# ");
-
-    return false;
-}
-
-static void checkSerialInPassthrough()
-{
-    static uint32_t lastData = 0;
-    static bool LED = false;
-    bool gotData = false;
-
-    // Simple data passthrough from in to crsf
-    unsigned int avail;
-    while ((avail = Serial.available()) != 0)
-    {
-        uint8_t buf[16];
-        avail = Serial.readBytes((char *)buf, min(sizeof(buf), avail));
-        crsf.write(buf, avail);
-        digitalWrite(DPIN_LED, LED);
-        LED = !LED;
-        gotData = true;
-    }
-
-    // If longer than X seconds since last data, switch out of passthrough
-    if (gotData || !lastData)
-        lastData = millis();
-    // Turn off LED 1s after last data
-    else if (LED && (millis() - lastData > 1000))
-    {
-        LED = false;
-        digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
-    }
-    // Short blink LED after timeout
-    else if (millis() - lastData > 5000)
-    {
-        lastData = 0;
-        digitalWrite(DPIN_LED, HIGH ^ LED_INVERTED);
-        delay(200);
-        digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
-        crsf.setPassthroughMode(false);
-    }
-}
-
-static void checkSerialInNormal()
-{
-    while (Serial.available())
-    {
-        char c = Serial.read();
-        if (g_State.serialEcho && c != '\n')
-            Serial.write(c);
-
-        if (c == '\r' || c == '\n')
-        {
-            if (g_State.serialInBuffLen != 0)
-            {
-                Serial.write('\n');
-
-                g_State.serialInBuff[g_State.serialInBuffLen] = '\0';
-                g_State.serialInBuffLen = 0;
-
-                bool goToPassthrough = handleSerialCommand(g_State.serialInBuff);
-                // If need to go to passthrough, get outta here before we dequeue any bytes
-                if (goToPassthrough)
-                    return;
-            }
-        }
-        else
-        {
-            g_State.serialInBuff[g_State.serialInBuffLen++] = c;
-            // if the buffer fills without getting a newline, just reset
-            if (g_State.serialInBuffLen >= sizeof(g_State.serialInBuff))
-                g_State.serialInBuffLen = 0;
-        }
-    }  /* while Serial */
-}
-
-static void checkSerialIn()
-{
-    if (crsf.getPassthroughMode())
-        checkSerialInPassthrough();
-    else
-        checkSerialInNormal();
-}
-
-static void setupCrsf()
-{
-    crsf.onLinkUp = &crsfLinkUp;
-    crsf.onLinkDown = &crsfLinkDown;
-    crsf.onOobData = &crsfOobData;
-    crsf.onPacketChannels = &packetChannels;
-    crsf.onPacketLinkStatistics = &packetLinkStatistics;
-    crsf.begin();
-}
-
-static void setupGpio()
-{
-    pinMode(DPIN_LED, OUTPUT);
-    digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
-    analogReadResolution(12);
-
-    // The servo outputs are initialized when the
-    // first channels packet comes in and sets the PWM
-    // output value, to prevent them from jerking around
-    // on startup
-}
-
-void setup()
-{
-    Serial.begin(115200);
-
-    setupGpio();
-    setupCrsf();
-}
-
-void loop()
-{
-    crsf.loop();
-    checkVbatt();
-    checkSerialIn();
-}
+#include <Arduino.h>
+#include <CrsfSerial.h>
+#include <CrsfRxDmaStm32.h>
+#include <median.h>
+#include <histogram.h>
+#include "target.h"
+#include "ServoTimer.h"
+#include "DshotOutput.h"
+#include "PpmOutput.h"
+#include <dshot.h>
+#include <sbus.h>
+
+#define NUM_OUTPUTS 8
+
+// Configuration
+// Map input CRSF channels (1-based, up to 16 for CRSF, 12 for ELRS) to outputs 1-8
+// use a negative number to invert the signal (i.e. +100% becomes -100%)
+constexpr int OUTPUT_MAP[NUM_OUTPUTS] = { 1, 2, 3, 4, 6, 7, 8, 12 };
+// The failsafe action for each channel (fsaNoPulses, fsaHold, or microseconds)
+constexpr int OUTPUT_FAILSAFE[NUM_OUTPUTS] = {
+    1500, 1500, 988, 1500,                  // ch1-ch4
+    fsaHold, fsaHold, fsaHold, fsaNoPulses  // ch5-ch8
+    };
+// Ignore changes in an output smaller than or equal to this many microseconds
+// (0 = update on any change). Unchanged outputs are never written to the hardware
+constexpr int OUTPUT_DEADBAND_US[NUM_OUTPUTS] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+// Define the pins used to output servo PWM, must use hardware PWM
+constexpr PinName OUTPUT_PINS[NUM_OUTPUTS] = { OUTPUT_PIN_MAP };
+// PWM frame rate of each output. Outputs on the same timer must use the same rate
+// e.g. 50 for analog servos, 333 or 560 for digital servos / ESCs which support it.
+// The pulse width must always be shorter than the period (1785us at 560Hz)
+#define PWM_FREQ_HZ     50
+constexpr unsigned int OUTPUT_RATE_HZ[NUM_OUTPUTS] = {
+    PWM_FREQ_HZ, PWM_FREQ_HZ, PWM_FREQ_HZ, PWM_FREQ_HZ,
+    PWM_FREQ_HZ, PWM_FREQ_HZ, PWM_FREQ_HZ, PWM_FREQ_HZ
+    };
+// Protocol of each output. Outputs on the same timer must use the same protocol
+// opOneShot125 (125-250us) and opMultishot (5-25us) are PWM with shorter pulses,
+// use a high OUTPUT_RATE_HZ such as 2000 or 4000 with them.
+// opDshot150/300/600 send one digital frame per channels packet, OUTPUT_RATE_HZ is not used.
+// DShot outputs below DSHOT_MIN_THROTTLE_US (e.g. a 988us failsafe) stop the motor
+enum eOutputProtocol { opPwm, opOneShot125, opMultishot, opDshot150, opDshot300, opDshot600 };
+constexpr eOutputProtocol OUTPUT_PROTOCOL[NUM_OUTPUTS] = {
+    opPwm, opPwm, opPwm, opPwm,
+    opPwm, opPwm, opPwm, opPwm
+    };
+#define DSHOT_MIN_THROTTLE_US   1000
+
+// Bitmask of the CRSF channels used by OUTPUT_MAP (bit 0 = channel 1), only these are decoded
+static constexpr uint32_t outputChannelMask(unsigned int out = 0)
+{
+    return (out < NUM_OUTPUTS) ?
+        (1U << (((OUTPUT_MAP[out] < 0) ? -OUTPUT_MAP[out] : OUTPUT_MAP[out]) - 1)) | outputChannelMask(out + 1) :
+        0;
+}
+
+#if defined(ARDUINO_ARCH_STM32)
+// Check every output has a timer, and outputs sharing a timer have the same rate and protocol
+static constexpr bool outputTimersValid(unsigned int a = 0, unsigned int b = 1)
+{
+    return (a >= NUM_OUTPUTS) ? true :
+        (servoTimerForPin(OUTPUT_PINS[a]) == 0) ? false :
+        (b >= NUM_OUTPUTS) ? outputTimersValid(a + 1, a + 2) :
+        (servoTimerForPin(OUTPUT_PINS[a]) == servoTimerForPin(OUTPUT_PINS[b]) &&
+            (OUTPUT_RATE_HZ[a] != OUTPUT_RATE_HZ[b] || OUTPUT_PROTOCOL[a] != OUTPUT_PROTOCOL[b])) ? false :
+        outputTimersValid(a, b + 1);
+}
+static_assert(outputTimersValid(), "OUTPUT_PINS must all be on a timer, and outputs on the same timer must have the same OUTPUT_RATE_HZ and OUTPUT_PROTOCOL");
+static constexpr bool outputTimerUnused(unsigned int timer, unsigned int out = 0)
+{
+    return (out >= NUM_OUTPUTS) ? true : (servoTimerForPin(OUTPUT_PINS[out]) != timer) && outputTimerUnused(timer, out + 1);
+}
+#else
+// The Pico's Servo library always runs at 50Hz
+static constexpr bool outputRatesDefault(unsigned int out = 0)
+{
+    return (out >= NUM_OUTPUTS) ? true : (OUTPUT_RATE_HZ[out] == 50) && outputRatesDefault(out + 1);
+}
+static_assert(outputRatesDefault(), "OUTPUT_RATE_HZ is not supported on this platform");
+static constexpr bool outputProtocolsPwm(unsigned int out = 0)
+{
+    return (out >= NUM_OUTPUTS) ? true : (OUTPUT_PROTOCOL[out] == opPwm) && outputProtocolsPwm(out + 1);
+}
+static_assert(outputProtocolsPwm(), "OUTPUT_PROTOCOL is not supported on this platform");
+#endif
+
+// Restart the PWM period when a channels packet arrives so new values are output
+// right away instead of up to a full period later. The period is never made shorter
+// than this, which must be longer than any pulse. 0 to leave the timers free running
+#define PWM_SYNC_MIN_PERIOD_US  0
+// Accept a faster CRSF baud when the receiver proposes one, up to this. The F103's USART1 can run
+// up to 4.5Mbaud and USART2/3 up to 2.25Mbaud. Goes back to 420000 if no frames arrive at the new baud
+//#define CRSF_MAX_BAUD       921600
+// Re-emit CRSF channels 1-16 as SBUS on a spare UART's TX pin, e.g. USART1 (TX=PA9) on the blue pill.
+// The STM32F1 UART can not invert its output, so SBUS inputs need an external inverter
+//#define SBUS_OUTPUT_USART   USART1
+// Re-emit CRSF channels 1-PPM_CHANNELS as a PPM train on a pin of a timer not used by OUTPUT_PINS
+//#define PPM_OUTPUT_PIN      PB_6
+#define PPM_CHANNELS        8
+#if !defined(ARDUINO_ARCH_STM32) && (defined(SBUS_OUTPUT_USART) || defined(PPM_OUTPUT_PIN))
+#error "SBUS_OUTPUT_USART and PPM_OUTPUT_PIN are only supported on STM32"
+#endif
+#if defined(PPM_OUTPUT_PIN)
+static_assert(servoTimerForPin(PPM_OUTPUT_PIN) != 0 && outputTimerUnused(servoTimerForPin(PPM_OUTPUT_PIN)),
+    "PPM_OUTPUT_PIN must be on a timer which is not used by OUTPUT_PINS");
+#define PPM_CHANNEL_MASK    ((1U << PPM_CHANNELS) - 1)
+#else
+#define PPM_CHANNEL_MASK    0
+#endif
+static_assert(SBUS_CHANNELS_SIZE == CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE, "SBUS channels are copied from the CRSF payload");
+#define VBAT_INTERVAL   500
+#define VBAT_SMOOTH     5
+// Scale used to calibrate or change to CRSF standard 0.1 scale
+#define VBAT_SCALE      1.0
+
+// Optimal safety and performance: Arm switch on AUX1 (channel 5)
+// It is not recommended to change the channel
+// See https://www.expresslrs.org/software/switch-config/
+// Only used if USE_ARMSWITCH defined
+#define ELRS_ARM_CHANNEL 5
+
+// Local Variables
+#if defined(ARDUINO_ARCH_STM32)
+static HardwareSerial CrsfSerialStream(USART_INPUT);
+#if defined(USE_CRSF_DMA)
+static CrsfRxDmaStm32 CrsfDmaRx(USART_INPUT);
+#if !defined(USART_INPUT_DMA_IRQHandler)
+#error "USE_CRSF_DMA needs USART_INPUT_DMA_IRQHandler defined for the target"
+#endif
+extern "C" void USART_INPUT_DMA_IRQHandler(void)
+{
+    CrsfDmaRx.handleIrq();
+}
+#endif
+#if defined(SBUS_OUTPUT_USART)
+static HardwareSerial SbusSerialStream(SBUS_OUTPUT_USART);
+#endif
+#if defined(PPM_OUTPUT_PIN)
+static PpmOutput g_Ppm;
+#endif
+#elif defined(TARGET_RASPBERRY_PI_PICO)
+static UART CrsfSerialStream(DPIN_CRSF_TX, DPIN_CRSF_RX);
+#endif
+static CrsfSerial crsf(CrsfSerialStream);
+static CrsfTelemetry g_Telemetry(crsf);
+#if defined(USE_CRSF_ISR)
+#if !defined(ARDUINO_ARCH_STM32)
+#error "USE_CRSF_ISR is only supported on STM32"
+#endif
+// Receive and output from the 1ms SysTick, and right away on receive DMA events,
+// so servo updates do not wait for loop()
+extern "C" void HAL_SYSTICK_Callback(void)
+{
+    crsf.isrLoop();
+}
+
+static void crsfRxEvent()
+{
+    crsf.isrLoop();
+}
+#endif
+// Output values in 1/8us (Q3) units, carried all the way to the timer
+// so the 0.625us CRSF resolution is not rounded to whole microseconds
+#define US_Q3(us)       ((us) << CRSF_US_Q3_SHIFT)
+static int g_OutputsQ3[NUM_OUTPUTS];
+#if defined(ARDUINO_ARCH_STM32)
+static ServoTimer g_Servos[NUM_OUTPUTS];
+static DshotOutput g_Dshot[NUM_OUTPUTS];
+#endif
+#if defined(TARGET_RASPBERRY_PI_PICO)
+#include <Servo.h>
+static Servo *g_Servos[NUM_OUTPUTS];
+#endif
+// Latency of each stage from the parser taking a channels frame's first byte to the outputs, in us.
+// Time the bytes spent waiting in the UART or DMA buffer before that is not included
+#define LATENCY_BUCKETS     64
+static struct tagLatencyHistograms {
+    Histogram<50, LATENCY_BUCKETS> parse;    // first byte parsed to crc valid, includes time on the wire only for bytes parsed as they arrive
+    Histogram<1, LATENCY_BUCKETS> dispatch;  // crc valid to onPacketChannels
+    Histogram<2, LATENCY_BUCKETS> output;    // onPacketChannels to outputs committed
+    Histogram<50, LATENCY_BUCKETS> total;
+} g_Latency;
+static struct tagConnectionState {
+    uint32_t lastVbatRead;
+    MedianAvgFilter<unsigned int, VBAT_SMOOTH>vbatSmooth;
+    unsigned int vbatValue;
+    // CrsfTelemetry sensor ids
+    int vbatSensor;
+#if defined(USE_CRSF_STATS_TELEMETRY)
+    int statsSensor;
+#endif
+
+    char serialInBuff[64];
+    uint8_t serialInBuffLen;
+    bool serialEcho;
+
+    uint32_t outputWrites;
+    uint32_t outputWritesElided;
+    // servoPlatformSet() calls and the cycleCount() spent in them
+    uint32_t outputSets;
+    uint32_t outputSetCycles;
+    // Time from channels packet to the start of the next pulse
+    uint32_t outputLatencyUs;
+    uint32_t outputLatencyMaxUs;
+    // CPU time spent re-emitting SBUS / PPM per channels packet
+    uint32_t reemitUs;
+    uint32_t reemitMaxUs;
+} g_State;
+
+static void crsfOobData(uint8_t b)
+{
+    // A shifty byte is usually just log messages from ELRS
+    Serial.write(b);
+}
+
+static constexpr uint32_t outputDshotKbps(unsigned int servo)
+{
+    return (OUTPUT_PROTOCOL[servo] == opDshot150) ? 150 :
+        (OUTPUT_PROTOCOL[servo] == opDshot300) ? 300 :
+        (OUTPUT_PROTOCOL[servo] == opDshot600) ? 600 :
+        0;
+}
+
+/**
+ * @brief: Convert a DSHOT_MIN_THROTTLE_US-2000us output to a DShot throttle value (48-2047)
+ * @details: Anything below DSHOT_MIN_THROTTLE_US sends motor stop (0), 48 is
+ *           the lowest throttle and keeps an armed ESC spinning
+*/
+static uint16_t outputDshotValue(int usQ3)
+{
+    if (usQ3 < US_Q3(DSHOT_MIN_THROTTLE_US))
+        return DSHOT_MOTOR_STOP;
+    int q3 = constrain(usQ3, US_Q3(DSHOT_MIN_THROTTLE_US), US_Q3(2000)) - US_Q3(DSHOT_MIN_THROTTLE_US);
+    return DSHOT_THROTTLE_MIN + q3 * (DSHOT_THROTTLE_MAX - DSHOT_THROTTLE_MIN) / US_Q3(2000 - DSHOT_MIN_THROTTLE_US);
+}
+
+/**
+ * @brief: Initialize a servo pin output, with the pin held low and no pulses until set
+ * @details: Called from setup() for every output, so the timer and DMA
+ *           setup never runs in the interrupt which receives the channels
+*/
+static void servoPlatformBegin(unsigned int servo)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    if (outputDshotKbps(servo) != 0)
+        g_Dshot[servo].begin(OUTPUT_PINS[servo], outputDshotKbps(servo));
+    else
+        g_Servos[servo].begin(OUTPUT_PINS[servo], OUTPUT_RATE_HZ[servo]);
+#endif
+    // Pi Pico attaches the servo when the first value is set
+}
+
+/**
+ * @brief: Set an already initialized servo to a value in 1/8us units
+*/
+static void servoPlatformSet(unsigned int servo, int usQ3)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    switch (OUTPUT_PROTOCOL[servo])
+    {
+    case opPwm:
+        g_Servos[servo].set(usQ3);
+        break;
+    case opOneShot125:
+        // 125-250us, 1/8 the PWM pulse width
+        g_Servos[servo].set(usQ3 / 8);
+        break;
+    case opMultishot:
+        // 5-25us
+        g_Servos[servo].set(US_Q3(5) + (constrain(usQ3, US_Q3(1000), US_Q3(2000)) - US_Q3(1000)) / 50);
+        break;
+    default:
+        // DShot begin() fails if the timer's DMA channel is already used
+        if (g_Dshot[servo].isStarted())
+            g_Dshot[servo].set(outputDshotValue(usQ3));
+        break;
+    }
+#endif
+#if defined(TARGET_RASPBERRY_PI_PICO)
+    int usec = (usQ3 + US_Q3(1) / 2) >> CRSF_US_Q3_SHIFT;
+    if (g_Servos[servo] == nullptr)
+    {
+        Servo *s = new Servo();
+        s->attach(OUTPUT_PINS[servo], CRSF_ELIMIT_US_MIN, CRSF_ELIMIT_US_MAX, usec);
+        g_Servos[servo] = s;
+    }
+    else
+        g_Servos[servo]->writeMicroseconds(usec);
+#endif
+}
+
+static void servoPlatformEnd(unsigned int servo)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    if (g_Servos[servo].isStarted())
+        g_Servos[servo].end();
+    if (g_Dshot[servo].isStarted())
+        g_Dshot[servo].end();
+#endif
+#if defined(TARGET_RASPBERRY_PI_PICO)
+     Servo *s = g_Servos[servo];
+     g_Servos[servo] = nullptr;
+     s->detach();
+     delete s;
+#endif
+}
+
+static bool servoIsChanged(unsigned int servo, int usQ3)
+{
+    int last = g_OutputsQ3[servo];
+    // Starting or stopping pulses is always a change
+    if (usQ3 <= 0 || last <= 0)
+        return usQ3 != last;
+
+    int delta = (usQ3 > last) ? usQ3 - last : last - usQ3;
+    return delta > US_Q3(OUTPUT_DEADBAND_US[servo]);
+}
+
+static void servoSet(unsigned int servo, int usQ3)
+{
+    if (!servoIsChanged(servo, usQ3))
+    {
+        ++g_State.outputWritesElided;
+        return;
+    }
+    ++g_State.outputWrites;
+
+    if (usQ3 > 0)
+    {
+        uint32_t start = cycleCount();
+        servoPlatformSet(servo, usQ3);
+        g_State.outputSetCycles += cycleCount() - start;
+        ++g_State.outputSets;
+    }
+    else
+    {
+        servoPlatformEnd(servo);
+    }
+    g_OutputsQ3[servo] = usQ3;
+}
+
+
+static void outputFailsafeValues()
+ {
+    for (unsigned int out=0; out<NUM_OUTPUTS; ++out)
+    {
+        if (OUTPUT_FAILSAFE[out] == fsaNoPulses)
+            servoSet(out, 0);
+        else if (OUTPUT_FAILSAFE[out] != fsaHold)
+            servoSet(out, US_Q3(OUTPUT_FAILSAFE[out]));
+        // else fsaHold does nothing, keep the same value
+    }
+#if defined(ARDUINO_ARCH_STM32)
+    DshotOutput::sendAll();
+#endif
+}
+
+
+#if defined(USE_ARMSWITCH)
+// If USE_ARMSWITCH flag is given during compilation, isArmed
+// checks if the arm signal was sent on channel defined by CRSF_ELRS_ARM_CHANNEL.
+// The arm signal has to be *over* 1500us
+static bool isArmed()
+{
+    // Static variable to store arm count, initialized to 0
+    static uint8_t armCount = 0;
+
+    if (crsf.getChannel(ELRS_ARM_CHANNEL) <= 1500)
+    {
+        armCount = 0;
+        return false;
+    }
+    // Require at least 4 packets with "arm" signal, in order to
+    // prevent accidental arming due to corrupt signals, similar
+    // to Betaflight
+    if (armCount < 4)
+    {
+        armCount++;
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief: Align the PWM period to the channels just set, and record how long
+ *         it will be until those values are seen on the outputs
+*/
+static void outputCommit(uint32_t packetUs)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    DshotOutput::sendAll();
+    uint32_t edgeWait = ServoTimer::syncPeriod(PWM_SYNC_MIN_PERIOD_US);
+    g_State.outputLatencyUs = (micros() - packetUs) + edgeWait;
+    if (g_State.outputLatencyUs > g_State.outputLatencyMaxUs)
+        g_State.outputLatencyMaxUs = g_State.outputLatencyUs;
+#endif
+}
+
+/**
+ * @brief: Add the stage timings of the channels packet just output to the latency histograms
+ * @param entryTime: cycleCount() on entering the channels packet callback
+*/
+static void latencyRecord(uint32_t entryTime)
+{
+    uint32_t commitTime = cycleCount();
+    uint32_t startTime = crsf.getChannelsStartTime();
+    uint32_t crcTime = crsf.getChannelsCrcTime();
+    g_Latency.parse.add(cycleCountToUs(crcTime - startTime));
+    g_Latency.dispatch.add(cycleCountToUs(entryTime - crcTime));
+    g_Latency.output.add(cycleCountToUs(commitTime - entryTime));
+    g_Latency.total.add(cycleCountToUs(commitTime - startTime));
+}
+
+template <uint32_t BUCKET_WIDTH, unsigned int N>
+static void latencyPrint(const char *name, const Histogram<BUCKET_WIDTH, N> &h)
+{
+    Serial.print(name);
+    Serial.print(" n=");
+    Serial.print(h.getCount(), DEC);
+    Serial.print(" p50=");
+    Serial.print(h.percentile(50), DEC);
+    Serial.print("us p99=");
+    Serial.print(h.percentile(99), DEC);
+    Serial.print("us max=");
+    Serial.print(h.getMax(), DEC);
+    Serial.println("us");
+}
+
+/**
+ * @brief: Re-emit the CRSF channels as SBUS and / or PPM
+ * @param sbusFlags: SBUS_FLAG_xxx sent in the SBUS frame
+*/
+static void reemitChannels(uint8_t sbusFlags)
+{
+#if defined(SBUS_OUTPUT_USART) || defined(PPM_OUTPUT_PIN)
+    uint32_t start = micros();
+#if defined(SBUS_OUTPUT_USART)
+    // Drop the frame if the last one is still going out, 25 bytes take 3ms at 100k 8E2
+    if (SbusSerialStream.availableForWrite() >= SBUS_FRAME_SIZE)
+    {
+        uint8_t frame[SBUS_FRAME_SIZE];
+        sbusBuildFrame(frame, crsf.getChannelsView().data(), sbusFlags);
+        SbusSerialStream.write(frame, sizeof(frame));
+    }
+#endif
+#if defined(PPM_OUTPUT_PIN)
+    for (unsigned int ch=0; ch<PPM_CHANNELS; ++ch)
+        g_Ppm.set(ch, crsf.getChannelUsQ3(ch + 1));
+    g_Ppm.commit();
+    // The train starts on the first packet, after the channels are set
+    g_Ppm.start();
+#endif
+    g_State.reemitUs = micros() - start;
+    if (g_State.reemitUs > g_State.reemitMaxUs)
+        g_State.reemitMaxUs = g_State.reemitUs;
+#endif
+}
+
+static void packetChannels()
+{
+    uint32_t entryTime = cycleCount();
+    uint32_t packetUs = micros();
+#if defined(USE_ARMSWITCH)
+    crsf.decodeChannels<outputChannelMask() | PPM_CHANNEL_MASK | (1U << (ELRS_ARM_CHANNEL - 1))>();
+    if (!isArmed())
+    {
+        outputFailsafeValues();
+        return;
+    }
+#else
+    crsf.decodeChannels<outputChannelMask() | PPM_CHANNEL_MASK>();
+#endif
+
+    for (unsigned int out=0; out<NUM_OUTPUTS; ++out)
+    {
+        const int chInput = OUTPUT_MAP[out];
+        int q3Output;
+        if (chInput > 0)
+            q3Output = crsf.getChannelUsQ3(chInput);
+        else
+        {
+            // if chInput is negative, invert the channel output
+            q3Output = crsf.getChannelUsQ3(-chInput);
+            // (1500 - q3Output) + 1500
+            q3Output = US_Q3(3000) - q3Output;
+        }
+        servoSet(out, q3Output);
+    }
+    outputCommit(packetUs);
+    latencyRecord(entryTime);
+    reemitChannels(0);
+
+    // for (unsigned int ch=1; ch<=4; ++ch)
+    // {
+    //     Serial.write(ch < 10 ? '0' + ch : 'A' + ch - 10);
+    //     Serial.write('=');
+    //     Serial.print(crsf.getChannel(ch), DEC);
+    //     Serial.write(' ');
+    // }
+    // Serial.println();
+}
+
+static void packetLinkStatistics(crsfLinkStatistics_t *link)
+{
+  //Serial.print(link->uplink_RSSI_1, DEC);
+  //Serial.println("dBm");
+}
+
+static void crsfLinkUp()
+{
+    digitalWrite(DPIN_LED, HIGH ^ LED_INVERTED);
+}
+
+static void crsfLinkDown()
+{
+    digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
+    outputFailsafeValues();
+    reemitChannels(SBUS_FLAG_FRAME_LOST | SBUS_FLAG_FAILSAFE);
+ }
+
+#if defined(USE_CRSF_STATS_TELEMETRY)
+/**
+ * @brief: Send the per second CRSF parser stats as flight mode text telemetry
+ *         "C<channels> E<crc errors> S<skipped bytes>"
+*/
+static void checkStatsTelemetry()
+{
+    static uint32_t lastSent;
+    if (millis() - lastSent < 1000)
+        return;
+    lastSent = millis();
+
+    const crsfParserStats_t &perSec = crsf.getStatsPerSec();
+    char text[sizeof(crsf_flight_mode_t)];
+    snprintf(text, sizeof(text), "C%u E%u S%u",
+        (unsigned int)perSec.frames[csfChannels], (unsigned int)perSec.crcErrors,
+        (unsigned int)perSec.skippedBytes);
+    g_Telemetry.update(g_State.statsSensor).bytes(text, strlen(text) + 1).commit();
+}
+#endif
+
+static void checkVbatt()
+{
+#if defined(APIN_VBAT)
+    if (millis() - g_State.lastVbatRead < (VBAT_INTERVAL / VBAT_SMOOTH))
+        return;
+    g_State.lastVbatRead = millis();
+
+    unsigned int idx = g_State.vbatSmooth.add(analogRead(APIN_VBAT));
+    if (idx != 0)
+        return;
+
+    unsigned int adc = g_State.vbatSmooth;
+    g_State.vbatValue = 330U * adc * (VBAT_R1 + VBAT_R2) / VBAT_R2 / ((1 << 12) - 1);
+
+    // crsf_sensor_battery_t, sent by the telemetry scheduler
+    uint16_t scaledVoltage = g_State.vbatValue * VBAT_SCALE;
+    g_Telemetry.update(g_State.vbatSensor)
+        .u16(scaledVoltage) // voltage
+        .u16(0)             // current
+        .u24(0)             // capacity
+        .u8(0)              // remaining
+        .commit();
+
+    //Serial.print("ADC="); Serial.print(adc, DEC);
+    //Serial.print(" "); Serial.print(g_State.vbatValue, DEC); Serial.println("V");
+#endif // APIN_VBAT
+}
+
+static void passthroughBegin(uint32_t baud)
+{
+    if (baud != crsf.getBaud())
+    {
+        // Force a reboot command since we want to send the reboot
+        // at 420000 then switch to what the user wanted
+        const uint8_t rebootpayload[] = { 'b', 'l' };
+        crsf.queuePacket(CRSF_FRAMETYPE_COMMAND, &rebootpayload, sizeof(rebootpayload));
+    }
+
+    crsf.setPassthroughMode(true, baud);
+    g_State.serialEcho = false;
+}
+
+/***
+ * @brief Processes a text command like we're some sort of CLI or something
+ * @return true if CrsfSerial was placed into passthrough mode, false otherwise
+*/
+static bool handleSerialCommand(char *cmd)
+{
+    // Fake a CRSF RX on UART6
+    bool prompt = true;
+    if (strcmp(cmd, "#") == 0)
+    {
+        Serial.println("Fake CLI Mode, type 'exit' or 'help' to do nothing\r\n");
+        g_State.serialEcho = true;
+    }
+
+    else if (strcmp(cmd, "serial") == 0)
+        Serial.println("serial 5 64 0 0 0 0\r\n");
+
+    else if (strcmp(cmd, "get serialrx_provider") == 0)
+        Serial.println("serialrx_provider = CRSF\r\n");
+
+    else if (strcmp(cmd, "get serialrx_inverted") == 0)
+        Serial.println("serialrx_inverted = OFF\r\n");
+
+    else if (strcmp(cmd, "get serialrx_halfduplex") == 0)
+        Serial.println("serialrx_halfduplex = OFF\r\n");
+
+    else if (strcmp(cmd, "channels") == 0)
+    {
+        CrsfChannelSnapshot snap;
+        crsf.getChannelSnapshot(snap);
+        Serial.print("frame=");
+        Serial.print(snap.seq, DEC);
+        Serial.print(" age=");
+        Serial.print(micros() - snap.arrivalUs, DEC);
+        Serial.println("us");
+        CrsfChannelsView view = snap.view();
+        for (unsigned int ch=1; ch<=CRSF_NUM_CHANNELS; ++ch)
+        {
+            Serial.print("ch");
+            Serial.print(ch, DEC);
+            Serial.print("=");
+            Serial.println(view.getUs(ch), DEC);
+        }
+    }
+
+    else if (strcmp(cmd, "crsfstats") == 0)
+    {
+        static const char * const FRAME_NAMES[csfCount] = { "channels", "linkstats", "gps", "other" };
+        const crsfParserStats_t &total = crsf.getStats();
+        const crsfParserStats_t &perSec = crsf.getStatsPerSec();
+        for (unsigned int i=0; i<csfCount; ++i)
+        {
+            Serial.print(FRAME_NAMES[i]);
+            Serial.print("=");
+            Serial.print(total.frames[i], DEC);
+            Serial.print(" (");
+            Serial.print(perSec.frames[i], DEC);
+            Serial.println("/s)");
+        }
+        Serial.print("crcerrors=");
+        Serial.print(total.crcErrors, DEC);
+        Serial.print(" (");
+        Serial.print(perSec.crcErrors, DEC);
+        Serial.print("/s) skipped=");
+        Serial.print(total.skippedBytes, DEC);
+        Serial.print(" (");
+        Serial.print(perSec.skippedBytes, DEC);
+        Serial.print("/s) overflows=");
+        Serial.print(total.overflows, DEC);
+        Serial.print(" timeouts=");
+        Serial.print(total.timeouts, DEC);
+        Serial.print(" oobdropped=");
+        Serial.print(total.oobDropped, DEC);
+        Serial.print(" rxoverruns=");
+        Serial.println(total.rxOverruns, DEC);
+        // Parse and read cost of the last second, per byte
+        Serial.print("parse=");
+        Serial.print(perSec.bytes, DEC);
+        Serial.print("B/s ");
+        Serial.print((perSec.bytes != 0) ? cycleCountToUs(perSec.parseCycles) * 1000U / perSec.bytes : 0, DEC);
+        Serial.print("ns/B read=");
+        Serial.print((perSec.bytes != 0) ? cycleCountToUs(perSec.readCycles) * 1000U / perSec.bytes : 0, DEC);
+        Serial.println("ns/B");
+        Serial.print("txdropped=");
+        Serial.print(crsf.getTxDropped(), DEC);
+        Serial.print(" txhighwater=");
+        Serial.println(crsf.getTxHighWater(), DEC);
+        Serial.print("telemetry budget=");
+        Serial.print(g_Telemetry.getBudget(), DEC);
+        Serial.print("B/s sent=");
+        Serial.print(g_Telemetry.getSent(), DEC);
+        Serial.print(" coalesced=");
+        Serial.println(g_Telemetry.getCoalesced(), DEC);
+        Serial.print("interval=");
+        Serial.print(crsf.getPacketIntervalUs(), DEC);
+        Serial.print("us failsafe=");
+        Serial.print(crsf.getFailsafeTimeoutMs(), DEC);
+        Serial.println("ms");
+    }
+
+    else if (strcmp(cmd, "latency") == 0)
+    {
+        latencyPrint("parse", g_Latency.parse);
+        latencyPrint("dispatch", g_Latency.dispatch);
+        latencyPrint("output", g_Latency.output);
+        latencyPrint("total", g_Latency.total);
+    }
+
+    else if (strcmp(cmd, "latency clear") == 0)
+    {
+        g_Latency.parse.clear();
+        g_Latency.dispatch.clear();
+        g_Latency.output.clear();
+        g_Latency.total.clear();
+    }
+
+    else if (strcmp(cmd, "outputs") == 0)
+    {
+        Serial.print("writes=");
+        Serial.print(g_State.outputWrites, DEC);
+        Serial.print(" elided=");
+        Serial.print(g_State.outputWritesElided, DEC);
+        // Average cost of one output write, cycles * 1000 converts to ns
+        Serial.print(" set=");
+        Serial.print((g_State.outputSets != 0) ? cycleCountToUs(g_State.outputSetCycles / g_State.outputSets * 1000U) : 0, DEC);
+        Serial.print("ns latency=");
+        Serial.print(g_State.outputLatencyUs, DEC);
+        Serial.print("us max=");
+        Serial.print(g_State.outputLatencyMaxUs, DEC);
+        Serial.println("us");
+#if defined(SBUS_OUTPUT_USART) || defined(PPM_OUTPUT_PIN)
+        Serial.print("reemit=");
+        Serial.print(g_State.reemitUs, DEC);
+        Serial.print("us max=");
+        Serial.print(g_State.reemitMaxUs, DEC);
+        Serial.println("us");
+#endif
+        for (unsigned int out=0; out<NUM_OUTPUTS; ++out)
+        {
+            Serial.print("out");
+            Serial.print(out + 1, DEC);
+#if defined(ARDUINO_ARCH_STM32)
+            Serial.print(" TIM");
+            Serial.print(servoTimerForPin(OUTPUT_PINS[out]), DEC);
+#endif
+            Serial.print(" ");
+            if (outputDshotKbps(out) != 0)
+            {
+                Serial.print("DShot");
+                Serial.print(outputDshotKbps(out), DEC);
+            }
+            else
+            {
+                Serial.print(OUTPUT_RATE_HZ[out], DEC);
+                Serial.print("Hz");
+            }
+            Serial.print(" ");
+            // Print as us with 3 decimal places
+            int q3 = g_OutputsQ3[out];
+            Serial.print(q3 >> CRSF_US_Q3_SHIFT, DEC);
+            Serial.print(".");
+            int frac = (q3 & (US_Q3(1) - 1)) * 1000 / US_Q3(1);
+            if (frac < 100)
+                Serial.print("0");
+            if (frac < 10)
+                Serial.print("0");
+            Serial.println(frac, DEC);
+        }
+    }
+
+    else if (strncmp(cmd, "serialpassthrough 5 ", 20) == 0)
+    {
+        // Just echo the command back, BF and iNav both send
+        // difference blocks of text as they start passthrough
+        Serial.println(cmd);
+
+        unsigned int baud = atoi(&cmd[20]);
+        passthroughBegin(baud);
+
+        return true;
+    }
+
+    else
+        prompt = false;
+
+    if (prompt)
+        Serial.print("# ");
+
+    return false;
+}
+
+static void checkSerialInPassthrough()
+{
+    static uint32_t lastData = 0;
+    static bool LED = false;
+    bool gotData = false;
+
+    // Simple data passthrough from in to crsf
+    unsigned int avail;
+    while ((avail = Serial.available()) != 0)
+    {
+        uint8_t buf[16];
+        avail = Serial.readBytes((char *)buf, min(sizeof(buf), avail));
+        crsf.write(buf, avail);
+        digitalWrite(DPIN_LED, LED);
+        LED = !LED;
+        gotData = true;
+    }
+
+    // If longer than X seconds since last data, switch out of passthrough
+    if (gotData || !lastData)
+        lastData = millis();
+    // Turn off LED 1s after last data
+    else if (LED && (millis() - lastData > 1000))
+    {
+        LED = false;
+        digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
+    }
+    // Short blink LED after timeout
+    else if (millis() - lastData > 5000)
+    {
+        lastData = 0;
+        digitalWrite(DPIN_LED, HIGH ^ LED_INVERTED);
+        delay(200);
+        digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
+        crsf.setPassthroughMode(false);
+    }
+}
+
+static void checkSerialInNormal()
+{
+    while (Serial.available())
+    {
+        char c = Serial.read();
+        if (g_State.serialEcho && c != '\n')
+            Serial.write(c);
+
+        if (c == '\r' || c == '\n')
+        {
+            if (g_State.serialInBuffLen != 0)
+            {
+                Serial.write('\n');
+
+                g_State.serialInBuff[g_State.serialInBuffLen] = '\0';
+                g_State.serialInBuffLen = 0;
+
+                bool goToPassthrough = handleSerialCommand(g_State.serialInBuff);
+                // If need to go to passthrough, get outta here before we dequeue any bytes
+                if (goToPassthrough)
+                    return;
+            }
+        }
+        else
+        {
+            g_State.serialInBuff[g_State.serialInBuffLen++] = c;
+            // if the buffer fills without getting a newline, just reset
+            if (g_State.serialInBuffLen >= sizeof(g_State.serialInBuff))
+                g_State.serialInBuffLen = 0;
+        }
+    }  /* while Serial */
+}
+
+static void checkSerialIn()
+{
+    if (crsf.getPassthroughMode())
+        checkSerialInPassthrough();
+    else
+        checkSerialInNormal();
+}
+
+static void setupCrsf()
+{
+    crsf.onLinkUp = &crsfLinkUp;
+    crsf.onLinkDown = &crsfLinkDown;
+    crsf.onOobData = &crsfOobData;
+    crsf.onPacketChannels = &packetChannels;
+    crsf.onPacketLinkStatistics = &packetLinkStatistics;
+#if defined(USE_CRSF_DMA)
+    crsf.setRxTransport(&CrsfDmaRx);
+#endif
+    crsf.begin();
+#if defined(CRSF_MAX_BAUD)
+    crsf.setMaxBaud(CRSF_MAX_BAUD);
+#endif
+    // Battery first, the stats text is only for debugging
+    g_State.vbatSensor = g_Telemetry.addSensor(CRSF_FRAMETYPE_BATTERY_SENSOR, 1, VBAT_INTERVAL);
+#if defined(USE_CRSF_STATS_TELEMETRY)
+    g_State.statsSensor = g_Telemetry.addSensor(CRSF_FRAMETYPE_FLIGHT_MODE, 0, 1000);
+#endif
+    crsf.setTelemetry(&g_Telemetry);
+#if defined(USE_CRSF_ISR)
+#if defined(USE_CRSF_DMA)
+    CrsfDmaRx.onRxEvent = &crsfRxEvent;
+#endif
+    crsf.setIsrMode(true);
+#endif
+}
+
+static void setupGpio()
+{
+    pinMode(DPIN_LED, OUTPUT);
+    digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
+    analogReadResolution(12);
+}
+
+static void setupOutputs()
+{
+    // The outputs are initialized here but stay low until the
+    // first channels packet comes in and sets the PWM
+    // output value, to prevent them from jerking around
+    // on startup
+    for (unsigned int out=0; out<NUM_OUTPUTS; ++out)
+        servoPlatformBegin(out);
+#if defined(PPM_OUTPUT_PIN)
+    g_Ppm.begin(PPM_OUTPUT_PIN, PPM_CHANNELS);
+#endif
+#if defined(SBUS_OUTPUT_USART)
+    SbusSerialStream.begin(SBUS_BAUD, SERIAL_8E2);
+#endif
+}
+
+void setup()
+{
+    Serial.begin(115200);
+
+    setupGpio();
+    setupOutputs();
+    setupCrsf();
+}
+
+void loop()
+{
+    crsf.loop();
+    checkVbatt();
+#if defined(USE_CRSF_STATS_TELEMETRY)
+    checkStatsTelemetry();
+#endif
+    checkSerialIn();
+}
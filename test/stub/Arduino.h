@@ -0,0 +1,61 @@
+#pragma once
+
+/**
+ * Minimal Arduino API for building the libraries in the native test env.
+ * Time only moves when a test calls hostClockAdvance(), so parser timeouts
+ * and link state are deterministic
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <endian.h>
+
+#define HEX 16
+#define DEC 10
+#define SERIAL_8E2 0x2e
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// inline rather than static, so every translation unit shares the one clock
+inline uint32_t &hostClockUs()
+{
+    static uint32_t us = 0;
+    return us;
+}
+inline void hostClockAdvance(uint32_t us) { hostClockUs() += us; }
+inline uint32_t micros() { return hostClockUs(); }
+inline uint32_t millis() { return hostClockUs() / 1000U; }
+static inline void noInterrupts() {}
+static inline void interrupts() {}
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t *buf, size_t len)
+    {
+        size_t retVal = 0;
+        while (len--)
+            retVal += write(*buf++);
+        return retVal;
+    }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    virtual void begin(unsigned long baud) {}
+    void begin(unsigned long baud, int config) { begin(baud); }
+    virtual void end() {}
+};
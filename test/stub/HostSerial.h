@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+// HardwareSerial which receives from rx and collects what is written in tx
+class HostSerial : public HardwareSerial
+{
+public:
+    std::vector<uint8_t> rx;
+    std::vector<uint8_t> tx;
+    size_t rxPos = 0;
+    unsigned long baud = 0;
+
+    void begin(unsigned long val) override { baud = val; }
+    int available() override { return rx.size() - rxPos; }
+    int read() override { return (rxPos < rx.size()) ? rx[rxPos++] : -1; }
+    int peek() override { return (rxPos < rx.size()) ? rx[rxPos] : -1; }
+    size_t write(uint8_t b) override
+    {
+        tx.push_back(b);
+        return 1;
+    }
+    int availableForWrite() override { return 64; }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <CrsfRxTransport.h>
+#include <vector>
+
+/**
+ * CrsfRxTransport over a circular buffer in memory, behaving like the DMA
+ * transport: write() always stores the data, and once the writer is more
+ * than a whole buffer ahead of the reader the unread data is dropped and
+ * counted as an overrun
+ */
+class MemRxTransport : public CrsfRxTransport
+{
+public:
+    MemRxTransport(size_t size) : _buf(size), _readTotal(0), _writeTotal(0), _overruns(0), _wrappedPeeks(0) {}
+
+    void begin() override
+    {
+        _readTotal = 0;
+        _writeTotal = 0;
+        _overruns = 0;
+    }
+
+    size_t peek(const uint8_t **buf) override
+    {
+        if (_writeTotal - _readTotal > _buf.size())
+        {
+            ++_overruns;
+            _readTotal = _writeTotal;
+        }
+
+        size_t readPos = _readTotal % _buf.size();
+        size_t len = _writeTotal - _readTotal;
+        *buf = &_buf[readPos];
+        if (readPos + len <= _buf.size())
+            return len;
+        // Data wraps the end of the buffer, return up to the end this time
+        ++_wrappedPeeks;
+        return _buf.size() - readPos;
+    }
+
+    void consume(size_t len) override { _readTotal += len; }
+
+    uint32_t takeOverruns() override
+    {
+        uint32_t retVal = _overruns;
+        _overruns = 0;
+        return retVal;
+    }
+
+    // The receiving side, as the DMA would
+    void write(const uint8_t *buf, size_t len)
+    {
+        while (len--)
+            _buf[_writeTotal++ % _buf.size()] = *buf++;
+    }
+
+    size_t space() const { return _buf.size() - (_writeTotal - _readTotal); }
+    // Times peek() stopped at the end of the buffer with more data after the wrap
+    uint32_t getWrappedPeeks() const { return _wrappedPeeks; }
+
+private:
+    std::vector<uint8_t> _buf;
+    size_t _readTotal;
+    size_t _writeTotal;
+    uint32_t _overruns;
+    uint32_t _wrappedPeeks;
+};
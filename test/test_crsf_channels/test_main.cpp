@@ -0,0 +1,188 @@
+#include <unity.h>
+#include <crsf_channels.h>
+#include <chrono>
+#include <stdio.h>
+
+void setUp() {}
+void tearDown() {}
+
+// crsfToUs() must match the CRSF_to_US() formula it replaced for every 11-bit value
+static void test_to_us_matches_formula()
+{
+    for (unsigned int crsf=0; crsf<2048; ++crsf)
+    {
+        TEST_ASSERT_EQUAL_UINT(CRSF_to_US(crsf), crsfToUs(crsf));
+        TEST_ASSERT_EQUAL_UINT(crsfToUs(crsf), crsfToUsQ3(crsf) >> CRSF_US_Q3_SHIFT);
+    }
+}
+
+// crsfFromUs() must match US_to_CRSF() over its whole documented range
+static void test_from_us_matches_formula()
+{
+    for (unsigned int us=880; us<=8191; ++us)
+        TEST_ASSERT_EQUAL_UINT(US_to_CRSF(us), crsfFromUs(us));
+}
+
+// Every raw value survives the trip through microseconds and back
+static void test_q3_round_trip()
+{
+    for (unsigned int crsf=0; crsf<2048; ++crsf)
+        TEST_ASSERT_EQUAL_UINT(crsf, crsfFromUsQ3(crsfToUsQ3(crsf)));
+}
+
+// The byte at a time unpacker from the original packetChannelsPacked(), minus the conversion to us
+static void refUnpackChannels(const uint8_t *buf, uint16_t *raw)
+{
+    constexpr unsigned inputMask = (1 << CRSF_BITS_PER_CHANNEL) - 1;
+    unsigned scratch = 0;
+    unsigned bitsInScratch = 0;
+    for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+    {
+        while (bitsInScratch < CRSF_BITS_PER_CHANNEL)
+        {
+            scratch |= (*buf++) << bitsInScratch;
+            bitsInScratch += 8;
+        }
+
+        raw[ch] = scratch & inputMask;
+        scratch >>= CRSF_BITS_PER_CHANNEL;
+        bitsInScratch -= CRSF_BITS_PER_CHANNEL;
+    }
+}
+
+// The packer from the original queuePacketChannels(), minus the conversion from us. It looped
+// while (bitsInScratch > 8) which never wrote the last byte, >= 8 here so it is complete
+static void refPackChannels(const uint16_t *raw, uint8_t *pbuf)
+{
+    uint32_t scratch = 0;
+    uint32_t bitsInScratch = 0;
+    for (unsigned ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+    {
+        scratch |= (uint32_t)raw[ch] << bitsInScratch;
+        bitsInScratch += CRSF_BITS_PER_CHANNEL;
+        while (bitsInScratch >= 8)
+        {
+            *pbuf++ = scratch;
+            scratch >>= 8;
+            bitsInScratch -= 8;
+        }
+    }
+}
+
+// Every 11-bit value in every channel slot, with random neighbours, packs and unpacks the same as the originals
+static void test_matches_original()
+{
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    uint16_t out[CRSF_NUM_CHANNELS];
+    uint16_t refOut[CRSF_NUM_CHANNELS];
+    uint8_t payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    uint8_t refPayload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+
+    uint32_t seed = 1;
+    for (unsigned int slot=0; slot<CRSF_NUM_CHANNELS; ++slot)
+    {
+        for (unsigned int val=0; val<2048; ++val)
+        {
+            for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+            {
+                seed = seed * 1103515245U + 12345U;
+                raw[ch] = (seed >> 16) & 0x7ff;
+            }
+            raw[slot] = val;
+
+            crsfPackChannels(raw, payload);
+            refPackChannels(raw, refPayload);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(refPayload, payload, sizeof(payload));
+
+            crsfUnpackChannels(payload, out);
+            refUnpackChannels(payload, refOut);
+            TEST_ASSERT_EQUAL_UINT16_ARRAY(refOut, out, CRSF_NUM_CHANNELS);
+            TEST_ASSERT_EQUAL_UINT16_ARRAY(raw, out, CRSF_NUM_CHANNELS);
+        }
+    }
+}
+
+static void test_pack_unpack_channels()
+{
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    uint16_t out[CRSF_NUM_CHANNELS];
+    uint8_t payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+
+    uint32_t seed = 1;
+    for (unsigned int iter=0; iter<1000; ++iter)
+    {
+        for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+        {
+            seed = seed * 1103515245U + 12345U;
+            raw[ch] = (seed >> 16) & 0x7ff;
+        }
+        crsfPackChannels(raw, payload);
+        crsfUnpackChannels(payload, out);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(raw, out, CRSF_NUM_CHANNELS);
+
+        // The single channel accessors and the generic bit packer agree with the unrolled ones
+        for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+            TEST_ASSERT_EQUAL_UINT(raw[ch], crsfUnpackChannel(payload, ch));
+        uint8_t bits[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+        TEST_ASSERT_EQUAL_UINT(sizeof(bits), crsfPackBits(raw, CRSF_BITS_PER_CHANNEL, CRSF_NUM_CHANNELS, bits));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, bits, sizeof(bits));
+    }
+}
+
+static void test_pack_single_channel()
+{
+    uint16_t raw[CRSF_NUM_CHANNELS] = { 0 };
+    uint16_t out[CRSF_NUM_CHANNELS];
+    uint8_t payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    crsfPackChannels(raw, payload);
+
+    // Setting one channel must not disturb its neighbours
+    for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+    {
+        raw[ch] = 0x7ff - ch;
+        crsfPackChannel(payload, ch, raw[ch]);
+        crsfUnpackChannels(payload, out);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(raw, out, CRSF_NUM_CHANNELS);
+    }
+}
+
+// Not a pass/fail test, prints the unpack cost of the original and the unrolled unpacker on this host
+static double nsPerCall(void (*fn)(const uint8_t *, uint16_t *), const uint8_t *data)
+{
+    static const unsigned int ITERATIONS = 200000;
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    volatile uint16_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i<ITERATIONS; ++i)
+    {
+        fn(data, raw);
+        sink = sink + raw[i % CRSF_NUM_CHANNELS];
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+static void test_unpack_cost()
+{
+    uint8_t data[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    for (unsigned int i=0; i<sizeof(data); ++i)
+        data[i] = i * 37;
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "unpack ns: original %.1f, unrolled %.1f",
+        nsPerCall(refUnpackChannels, data), nsPerCall(crsfUnpackChannels, data));
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_to_us_matches_formula);
+    RUN_TEST(test_from_us_matches_formula);
+    RUN_TEST(test_q3_round_trip);
+    RUN_TEST(test_matches_original);
+    RUN_TEST(test_pack_unpack_channels);
+    RUN_TEST(test_pack_single_channel);
+    RUN_TEST(test_unpack_cost);
+    return UNITY_END();
+}
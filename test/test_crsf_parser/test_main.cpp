@@ -0,0 +1,295 @@
+#include <unity.h>
+#include <CrsfSerial.h>
+#include <HostSerial.h>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+static uint32_t g_Seed = 1;
+static unsigned int rnd(unsigned int range)
+{
+    g_Seed = g_Seed * 1103515245U + 12345U;
+    return (g_Seed >> 8) % range;
+}
+
+/**
+ * The parser as it was before the ring buffer: a linear buffer shifted down
+ * one byte at a time on a resync, and the crc of each candidate frame
+ * calculated from scratch. The one intended difference is kept here too,
+ * the last byte of a buffer dropped a byte at a time is passed to OobData
+ */
+class ShiftParser
+{
+public:
+    std::vector<uint8_t> oob;
+    uint32_t frames[csfCount] = { 0 };
+    uint32_t crcErrors = 0;
+    uint32_t skippedBytes = 0;
+
+    void processBytes(const uint8_t *buf, size_t len)
+    {
+        while (len--)
+        {
+            _rxBuf[_rxBufPos++] = *buf++;
+            handleByteReceived();
+            if (_rxBufPos == CRSF_MAX_PACKET_SIZE)
+                _rxBufPos = 0;
+        }
+    }
+
+    // Packet timeout, flush the buffer a byte at a time
+    void flush()
+    {
+        while (_rxBufPos)
+            shiftRxBuffer(1);
+    }
+
+private:
+    uint8_t _rxBuf[CRSF_MAX_PACKET_SIZE];
+    uint8_t _rxBufPos = 0;
+
+    void handleByteReceived()
+    {
+        bool reprocess;
+        do
+        {
+            reprocess = false;
+            if (_rxBufPos > 1)
+            {
+                uint8_t len = _rxBuf[1];
+                if (len < 3 || len > (CRSF_MAX_PAYLOAD_LEN + 2))
+                {
+                    shiftRxBuffer(1);
+                    reprocess = true;
+                }
+                else if (_rxBufPos >= (len + 2))
+                {
+                    if (Crc8<0xd5>::calc(&_rxBuf[2], len - 1) == _rxBuf[len + 1])
+                    {
+                        processPacketIn();
+                        shiftRxBuffer(len + 2);
+                    }
+                    else
+                    {
+                        ++crcErrors;
+                        shiftRxBuffer(1);
+                    }
+                    reprocess = true;
+                }
+            }
+        } while (reprocess);
+    }
+
+    void processPacketIn()
+    {
+        switch (_rxBuf[2])
+        {
+        case CRSF_FRAMETYPE_GPS:
+            ++frames[csfGps];
+            break;
+        case CRSF_FRAMETYPE_RC_CHANNELS_PACKED:
+        case CRSF_FRAMETYPE_SUBSET_RC_CHANNELS_PACKED:
+            ++frames[csfChannels];
+            break;
+        case CRSF_FRAMETYPE_LINK_STATISTICS:
+            ++frames[csfLinkStatistics];
+            break;
+        default:
+            ++frames[csfOther];
+            break;
+        }
+    }
+
+    void shiftRxBuffer(uint8_t cnt)
+    {
+        if (cnt == 1)
+        {
+            ++skippedBytes;
+            oob.push_back(_rxBuf[0]);
+        }
+        if (cnt >= _rxBufPos)
+        {
+            _rxBufPos = 0;
+            return;
+        }
+        _rxBufPos -= cnt;
+        memmove(&_rxBuf[0], &_rxBuf[cnt], _rxBufPos);
+    }
+};
+
+static void appendFrame(std::vector<uint8_t> &stream, uint8_t type, unsigned int payloadLen)
+{
+    size_t start = stream.size();
+    stream.push_back(CRSF_SYNC_BYTE);
+    stream.push_back(payloadLen + 2);
+    stream.push_back(type);
+    for (unsigned int i=0; i<payloadLen; ++i)
+        stream.push_back(rnd(256));
+    stream.push_back(Crc8<0xd5>::calc(&stream[start + 2], payloadLen + 1));
+}
+
+// Good frames of the common types, optionally with noise between them and bytes corrupted
+static std::vector<uint8_t> makeStream(unsigned int frameCnt, unsigned int noisePct, unsigned int corruptPct)
+{
+    static const struct { uint8_t type; uint8_t len; } FRAMES[] = {
+        { CRSF_FRAMETYPE_RC_CHANNELS_PACKED, CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE },
+        { CRSF_FRAMETYPE_LINK_STATISTICS, sizeof(crsfLinkStatistics_t) },
+        { CRSF_FRAMETYPE_GPS, sizeof(crsf_sensor_gps_t) },
+        { CRSF_FRAMETYPE_BATTERY_SENSOR, 8 },
+        { CRSF_FRAMETYPE_FLIGHT_MODE, 0 },
+    };
+
+    std::vector<uint8_t> stream;
+    for (unsigned int i=0; i<frameCnt; ++i)
+    {
+        if (rnd(100) < noisePct)
+        {
+            // Noise which often looks like the start of a frame
+            unsigned int cnt = 1 + rnd(12);
+            while (cnt--)
+                stream.push_back((rnd(4) == 0) ? CRSF_SYNC_BYTE : rnd(256));
+        }
+
+        unsigned int idx = rnd(sizeof(FRAMES) / sizeof(FRAMES[0]));
+        unsigned int len = (FRAMES[idx].len != 0) ? FRAMES[idx].len : 1 + rnd(CRSF_MAX_PAYLOAD_LEN);
+        size_t start = stream.size();
+        appendFrame(stream, FRAMES[idx].type, len);
+        for (size_t pos=start; pos<stream.size(); ++pos)
+            if (rnd(1000) < corruptPct * 10)
+                stream[pos] = rnd(256);
+    }
+    return stream;
+}
+
+static std::vector<uint8_t> g_Oob;
+static void collectOob(uint8_t b)
+{
+    g_Oob.push_back(b);
+}
+
+// The same stream through CrsfSerial in random size chunks and through ShiftParser
+static void checkEquivalent(const std::vector<uint8_t> &stream)
+{
+    hostClockUs() = 0;
+    HostSerial port;
+    CrsfSerial crsf(port);
+    crsf.onOobData = &collectOob;
+    crsf.begin();
+    g_Oob.clear();
+
+    size_t pos = 0;
+    while (pos < stream.size())
+    {
+        size_t cnt = 1 + rnd(CRSF_MAX_PACKET_SIZE * 2);
+        if (cnt > stream.size() - pos)
+            cnt = stream.size() - pos;
+        crsf.processBytes(&stream[pos], cnt);
+        pos += cnt;
+    }
+    // Let the packet timeout flush any partial frame left at the end
+    hostClockAdvance((CrsfSerial::CRSF_PACKET_TIMEOUT_MS + 1) * 1000U);
+    crsf.loop();
+
+    ShiftParser ref;
+    ref.processBytes(stream.data(), stream.size());
+    ref.flush();
+
+    const crsfParserStats_t &stats = crsf.getStats();
+    for (unsigned int i=0; i<csfCount; ++i)
+        TEST_ASSERT_EQUAL_UINT32(ref.frames[i], stats.frames[i]);
+    TEST_ASSERT_EQUAL_UINT32(ref.crcErrors, stats.crcErrors);
+    TEST_ASSERT_EQUAL_UINT32(ref.skippedBytes, stats.skippedBytes);
+    TEST_ASSERT_EQUAL_UINT32(stream.size(), stats.bytes);
+    TEST_ASSERT_EQUAL_UINT32(ref.oob.size(), g_Oob.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(ref.oob.data(), g_Oob.data(), g_Oob.size());
+}
+
+static void test_clean_stream()
+{
+    std::vector<uint8_t> stream = makeStream(200, 0, 0);
+    checkEquivalent(stream);
+}
+
+static void test_noisy_streams()
+{
+    for (unsigned int iter=0; iter<2000; ++iter)
+        checkEquivalent(makeStream(20, 30, 0));
+}
+
+static void test_corrupted_streams()
+{
+    for (unsigned int iter=0; iter<2000; ++iter)
+        checkEquivalent(makeStream(20, 30, 2));
+}
+
+// Random bytes, any frames found are the ones with a lucky length and crc
+static void test_random_streams()
+{
+    for (unsigned int iter=0; iter<2000; ++iter)
+    {
+        std::vector<uint8_t> stream;
+        unsigned int cnt = rnd(512);
+        while (cnt--)
+            stream.push_back((rnd(8) == 0) ? CRSF_SYNC_BYTE : rnd(256));
+        checkEquivalent(stream);
+    }
+}
+
+// Not a pass/fail test, prints the parse cost per byte on this host for CrsfSerial and ShiftParser
+template <class Parser>
+static double nsPerByte(const std::vector<uint8_t> &stream)
+{
+    static const unsigned int PASSES = 50;
+    static const size_t CHUNK = 64;
+    HostSerial port;
+    CrsfSerial crsf(port);
+    Parser parser(crsf);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int pass=0; pass<PASSES; ++pass)
+        for (size_t pos=0; pos<stream.size(); pos+=CHUNK)
+            parser.process(&stream[pos], (stream.size() - pos < CHUNK) ? stream.size() - pos : CHUNK);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (PASSES * stream.size());
+}
+
+struct CrsfSerialParser
+{
+    CrsfSerial &crsf;
+    CrsfSerialParser(CrsfSerial &c) : crsf(c) {}
+    void process(const uint8_t *buf, size_t len) { crsf.processBytes(buf, len); }
+};
+
+struct ShiftParserParser
+{
+    ShiftParser parser;
+    ShiftParserParser(CrsfSerial &) {}
+    void process(const uint8_t *buf, size_t len) { parser.processBytes(buf, len); }
+};
+
+static void test_parse_cost()
+{
+    std::vector<uint8_t> clean = makeStream(2000, 0, 0);
+    std::vector<uint8_t> corrupted = makeStream(2000, 30, 2);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "parse ns/B clean: ring %.2f, shift %.2f",
+        nsPerByte<CrsfSerialParser>(clean), nsPerByte<ShiftParserParser>(clean));
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "parse ns/B corrupted: ring %.2f, shift %.2f",
+        nsPerByte<CrsfSerialParser>(corrupted), nsPerByte<ShiftParserParser>(corrupted));
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_stream);
+    RUN_TEST(test_noisy_streams);
+    RUN_TEST(test_corrupted_streams);
+    RUN_TEST(test_random_streams);
+    RUN_TEST(test_parse_cost);
+    return UNITY_END();
+}
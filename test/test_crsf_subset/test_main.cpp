@@ -0,0 +1,96 @@
+#include <unity.h>
+#include <crsf_channels.h>
+#include <chrono>
+#include <stdio.h>
+
+void setUp() {}
+void tearDown() {}
+
+// Sync + Len + Type + CRC around the payload
+#define FRAME_OVERHEAD  4
+
+// Bytes on the wire for cnt channels as a subset frame at res
+static unsigned int subsetFrameBytes(unsigned int cnt, unsigned int res)
+{
+    uint16_t raw[CRSF_NUM_CHANNELS] = { 0 };
+    uint8_t data[CRSF_SUBSET_RC_MAX_PAYLOAD_SIZE];
+    return FRAME_OVERHEAD + 1 + crsfPackBits(raw, crsfSubsetBits(res), cnt, data);
+}
+
+static void test_frame_bytes()
+{
+    TEST_ASSERT_EQUAL_UINT(26, FRAME_OVERHEAD + CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE);
+    TEST_ASSERT_EQUAL_UINT(11, subsetFrameBytes(4, csr11Bit));
+    TEST_ASSERT_EQUAL_UINT(7, subsetFrameBytes(1, csr11Bit));
+    TEST_ASSERT_EQUAL_UINT(25, subsetFrameBytes(16, csr10Bit));
+    TEST_ASSERT_EQUAL_UINT(27, subsetFrameBytes(16, csr11Bit));
+    TEST_ASSERT_EQUAL_UINT(29, subsetFrameBytes(16, csr12Bit));
+    TEST_ASSERT_EQUAL_UINT(31, subsetFrameBytes(16, csr13Bit));
+    TEST_ASSERT_EQUAL_UINT(CRSF_SUBSET_RC_MAX_PAYLOAD_SIZE + FRAME_OVERHEAD, subsetFrameBytes(16, csr13Bit));
+}
+
+// Every value of every resolution packs, unpacks and converts back to the same raw value
+static void test_round_trip()
+{
+    for (unsigned int res=csr10Bit; res<=csr13Bit; ++res)
+    {
+        unsigned int bits = crsfSubsetBits(res);
+        uint16_t raw[CRSF_NUM_CHANNELS];
+        uint16_t out[CRSF_NUM_CHANNELS];
+        uint8_t data[CRSF_SUBSET_RC_MAX_PAYLOAD_SIZE];
+        for (unsigned int base=0; base<(1U << bits); base+=CRSF_NUM_CHANNELS)
+        {
+            for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+                raw[ch] = (base + ch) & ((1U << bits) - 1);
+            crsfPackBits(raw, bits, CRSF_NUM_CHANNELS, data);
+            crsfUnpackBits(data, bits, CRSF_NUM_CHANNELS, out);
+            TEST_ASSERT_EQUAL_UINT16_ARRAY(raw, out, CRSF_NUM_CHANNELS);
+            for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+                TEST_ASSERT_EQUAL_UINT(raw[ch], crsfSubsetFromUsQ3(crsfSubsetToUsQ3(raw[ch], res), res));
+        }
+        // The top of every resolution is one step under 2012us
+        TEST_ASSERT_EQUAL_UINT(2012 << CRSF_US_Q3_SHIFT,
+            crsfSubsetToUsQ3((1U << bits) - 1, res) + ((1U << CRSF_US_Q3_SHIFT) >> res));
+    }
+}
+
+// Not a pass/fail test, prints the decode cost of each frame layout on this host
+static double nsPerCall(void (*fn)(const uint8_t *, uint16_t *), const uint8_t *data)
+{
+    static const unsigned int ITERATIONS = 200000;
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    volatile uint16_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i<ITERATIONS; ++i)
+    {
+        fn(data, raw);
+        sink = sink + raw[i % CRSF_NUM_CHANNELS];
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+static void decodeFull(const uint8_t *data, uint16_t *raw) { crsfUnpackChannels(data, raw); }
+static void decodeSubset4(const uint8_t *data, uint16_t *raw) { crsfUnpackBits(data, 11, 4, raw); }
+static void decodeSubset16(const uint8_t *data, uint16_t *raw) { crsfUnpackBits(data, 11, 16, raw); }
+
+static void test_decode_cost()
+{
+    uint8_t data[CRSF_SUBSET_RC_MAX_PAYLOAD_SIZE];
+    for (unsigned int i=0; i<sizeof(data); ++i)
+        data[i] = i * 37;
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "decode ns: full %.1f, 4ch subset %.1f, 16ch subset %.1f",
+        nsPerCall(decodeFull, data), nsPerCall(decodeSubset4, data), nsPerCall(decodeSubset16, data));
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_bytes);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_decode_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+#include <unity.h>
+#include <CrsfSerial.h>
+#include <HostSerial.h>
+#include <MemRxTransport.h>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+static uint32_t g_Seed = 1;
+static unsigned int rnd(unsigned int range)
+{
+    g_Seed = g_Seed * 1103515245U + 12345U;
+    return (g_Seed >> 8) % range;
+}
+
+// GPS frame with the sequence number in the latitude, so every frame delivered can be checked
+static void appendGpsFrame(std::vector<uint8_t> &stream, uint32_t seq)
+{
+    size_t start = stream.size();
+    stream.push_back(CRSF_SYNC_BYTE);
+    stream.push_back(sizeof(crsf_sensor_gps_t) + 2);
+    stream.push_back(CRSF_FRAMETYPE_GPS);
+    for (int shift=24; shift>=0; shift-=8)
+        stream.push_back(seq >> shift);
+    for (size_t i=4; i<sizeof(crsf_sensor_gps_t); ++i)
+        stream.push_back(rnd(256));
+    stream.push_back(Crc8<0xd5>::calc(&stream[start + 2], sizeof(crsf_sensor_gps_t) + 1));
+}
+
+static std::vector<uint32_t> g_Seqs;
+static void collectGps(crsf_sensor_gps_t *gps)
+{
+    g_Seqs.push_back(gps->latitude);
+}
+
+static void checkSeqs(uint32_t first, uint32_t cnt)
+{
+    TEST_ASSERT_EQUAL_UINT32(cnt, g_Seqs.size());
+    for (uint32_t i=0; i<cnt; ++i)
+        TEST_ASSERT_EQUAL_UINT32(first + i, g_Seqs[i]);
+}
+
+// Write the stream to the transport in random size blocks, running loop() between them
+static void feed(CrsfSerial &crsf, MemRxTransport &transport, const std::vector<uint8_t> &stream)
+{
+    size_t pos = 0;
+    while (pos < stream.size())
+    {
+        size_t cnt = 1 + rnd(transport.space());
+        if (cnt > stream.size() - pos)
+            cnt = stream.size() - pos;
+        transport.write(&stream[pos], cnt);
+        pos += cnt;
+        hostClockAdvance(100);
+        crsf.loop();
+    }
+}
+
+// A buffer size which is not a multiple of the frame size, so the wrap falls at every point in a frame
+static void test_frames_across_wrap()
+{
+    HostSerial port;
+    CrsfSerial crsf(port);
+    MemRxTransport transport(50);
+    crsf.onPacketGps = &collectGps;
+    crsf.setRxTransport(&transport);
+    crsf.begin();
+    g_Seqs.clear();
+
+    std::vector<uint8_t> stream;
+    for (uint32_t seq=0; seq<500; ++seq)
+        appendGpsFrame(stream, seq);
+    feed(crsf, transport, stream);
+
+    checkSeqs(0, 500);
+    const crsfParserStats_t &stats = crsf.getStats();
+    TEST_ASSERT_EQUAL_UINT32(stream.size(), stats.bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.skippedBytes);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.crcErrors);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.rxOverruns);
+    TEST_ASSERT_TRUE(transport.getWrappedPeeks() > 0);
+}
+
+// loop() not called in time, the partial frame before the overrun is dropped and the parser resyncs
+static void test_overrun()
+{
+    HostSerial port;
+    CrsfSerial crsf(port);
+    MemRxTransport transport(50);
+    crsf.onPacketGps = &collectGps;
+    crsf.setRxTransport(&transport);
+    crsf.begin();
+    g_Seqs.clear();
+
+    // Ends partway through frame 10
+    std::vector<uint8_t> stream;
+    for (uint32_t seq=0; seq<11; ++seq)
+        appendGpsFrame(stream, seq);
+    stream.resize(stream.size() - 7);
+    feed(crsf, transport, stream);
+    checkSeqs(0, 10);
+
+    // More than a buffer's worth arrives before the next loop(), all of it is lost
+    stream.clear();
+    for (uint32_t seq=100; seq<105; ++seq)
+        appendGpsFrame(stream, seq);
+    transport.write(stream.data(), stream.size());
+    hostClockAdvance(100);
+    crsf.loop();
+    TEST_ASSERT_EQUAL_UINT32(1, crsf.getStats().rxOverruns);
+    checkSeqs(0, 10);
+
+    // The rest of the partial frame never arrives, every frame after the overrun is found
+    stream.clear();
+    for (uint32_t seq=200; seq<300; ++seq)
+        appendGpsFrame(stream, seq);
+    feed(crsf, transport, stream);
+
+    TEST_ASSERT_EQUAL_UINT32(110, g_Seqs.size());
+    for (uint32_t i=0; i<100; ++i)
+        TEST_ASSERT_EQUAL_UINT32(200 + i, g_Seqs[10 + i]);
+    const crsfParserStats_t &stats = crsf.getStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rxOverruns);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(crsf_sensor_gps_t) + 4 - 7, stats.skippedBytes);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_across_wrap);
+    RUN_TEST(test_overrun);
+    return UNITY_END();
+}
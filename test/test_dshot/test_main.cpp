@@ -0,0 +1,83 @@
+#include <unity.h>
+#include <dshot.h>
+
+void setUp() {}
+void tearDown() {}
+
+// The CRC is the XOR of the three nibbles of value + telemetry bit
+static uint16_t specCrc(uint16_t value, bool telemetry)
+{
+    uint16_t packet = (value << 1) | (telemetry ? 1 : 0);
+    uint16_t crc = 0;
+    for (unsigned int nibble=0; nibble<3; ++nibble)
+        crc ^= (packet >> (nibble * 4)) & 0x0f;
+    return crc;
+}
+
+static void test_frame_known_values()
+{
+    // Motor stop is all zeros, so it is never mistaken for a throttle
+    TEST_ASSERT_EQUAL_HEX16(0x0000, dshotFrame(DSHOT_MOTOR_STOP, false));
+    TEST_ASSERT_EQUAL_HEX16(0x0606, dshotFrame(DSHOT_THROTTLE_MIN, false));
+    TEST_ASSERT_EQUAL_HEX16(0x82c6, dshotFrame(1046, false));
+    TEST_ASSERT_EQUAL_HEX16(0xffff, dshotFrame(DSHOT_THROTTLE_MAX, true));
+}
+
+static void test_frame_all_values()
+{
+    for (uint16_t value=0; value<=DSHOT_THROTTLE_MAX; ++value)
+    {
+        for (unsigned int telemetry=0; telemetry<2; ++telemetry)
+        {
+            uint16_t frame = dshotFrame(value, telemetry);
+            TEST_ASSERT_EQUAL_UINT16(value, frame >> 5);
+            TEST_ASSERT_EQUAL_UINT16(telemetry, (frame >> 4) & 1);
+            TEST_ASSERT_EQUAL_UINT16(specCrc(value, telemetry), frame & 0x0f);
+        }
+    }
+}
+
+// A 0 is high for 37.5% of the bit and a 1 for 75%
+static void test_bit_ticks()
+{
+    // 72MHz timer ticks per bit at DShot600, 300 and 150
+    TEST_ASSERT_EQUAL_UINT16(45, dshotBit0Ticks(120));
+    TEST_ASSERT_EQUAL_UINT16(90, dshotBit1Ticks(120));
+    TEST_ASSERT_EQUAL_UINT16(90, dshotBit0Ticks(240));
+    TEST_ASSERT_EQUAL_UINT16(180, dshotBit1Ticks(240));
+    TEST_ASSERT_EQUAL_UINT16(180, dshotBit0Ticks(480));
+    TEST_ASSERT_EQUAL_UINT16(360, dshotBit1Ticks(480));
+}
+
+static void test_frame_to_ticks()
+{
+    const uint16_t bit0 = dshotBit0Ticks(120);
+    const uint16_t bit1 = dshotBit1Ticks(120);
+    const unsigned int stride = 4;
+    uint16_t buf[DSHOT_FRAME_BITS * stride];
+    for (unsigned int i=0; i<DSHOT_FRAME_BITS * stride; ++i)
+        buf[i] = 0xffff;
+
+    // Interleaved into the second of four outputs, MSB first
+    uint16_t frame = dshotFrame(1046, false);
+    dshotFrameToTicks(frame, bit0, bit1, &buf[1], stride);
+    for (unsigned int bit=0; bit<DSHOT_FRAME_BITS; ++bit)
+    {
+        bool one = frame & (0x8000 >> bit);
+        TEST_ASSERT_EQUAL_UINT16(one ? bit1 : bit0, buf[bit * stride + 1]);
+        // The other outputs' entries are untouched
+        TEST_ASSERT_EQUAL_HEX16(0xffff, buf[bit * stride]);
+        TEST_ASSERT_EQUAL_HEX16(0xffff, buf[bit * stride + 2]);
+        TEST_ASSERT_EQUAL_HEX16(0xffff, buf[bit * stride + 3]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_known_values);
+    RUN_TEST(test_frame_all_values);
+    RUN_TEST(test_bit_ticks);
+    RUN_TEST(test_frame_to_ticks);
+    return UNITY_END();
+}
@@ -0,0 +1,73 @@
+#include <unity.h>
+#include <sbus.h>
+#include <crsf_channels.h>
+
+void setUp() {}
+void tearDown() {}
+
+// Reference SBUS decode, one bit at a time: 16 channels of 11 bits LSB first after the header
+static uint16_t specChannel(const uint8_t *frame, unsigned int ch)
+{
+    uint16_t val = 0;
+    for (unsigned int bit=0; bit<11; ++bit)
+    {
+        unsigned int pos = ch * 11 + bit;
+        if (frame[1 + pos / 8] & (1 << (pos % 8)))
+            val |= 1 << bit;
+    }
+    return val;
+}
+
+static void test_round_trip()
+{
+    uint16_t raw[CRSF_NUM_CHANNELS];
+    uint16_t out[CRSF_NUM_CHANNELS];
+    uint8_t packed[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    uint8_t frame[SBUS_FRAME_SIZE];
+
+    uint32_t seed = 1;
+    for (unsigned int iter=0; iter<1000; ++iter)
+    {
+        for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+        {
+            seed = seed * 1103515245U + 12345U;
+            raw[ch] = (seed >> 16) & 0x7ff;
+        }
+        uint8_t flags = iter & (SBUS_FLAG_CH17 | SBUS_FLAG_CH18 | SBUS_FLAG_FRAME_LOST | SBUS_FLAG_FAILSAFE);
+
+        crsfPackChannels(raw, packed);
+        sbusBuildFrame(frame, packed, flags);
+        TEST_ASSERT_EQUAL_HEX8(SBUS_HEADER, frame[0]);
+        TEST_ASSERT_EQUAL_HEX8(flags, frame[SBUS_FRAME_SIZE - 2]);
+        TEST_ASSERT_EQUAL_HEX8(SBUS_FOOTER, frame[SBUS_FRAME_SIZE - 1]);
+
+        const uint8_t *channels = sbusFrameChannels(frame);
+        TEST_ASSERT_TRUE(channels != nullptr);
+        crsfUnpackChannels(channels, out);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(raw, out, CRSF_NUM_CHANNELS);
+        for (unsigned int ch=0; ch<CRSF_NUM_CHANNELS; ++ch)
+            TEST_ASSERT_EQUAL_UINT16(raw[ch], specChannel(frame, ch));
+    }
+}
+
+static void test_bad_frame()
+{
+    uint8_t packed[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE] = { 0 };
+    uint8_t frame[SBUS_FRAME_SIZE];
+
+    sbusBuildFrame(frame, packed, 0);
+    frame[0] = 0x00;
+    TEST_ASSERT_TRUE(sbusFrameChannels(frame) == nullptr);
+
+    sbusBuildFrame(frame, packed, 0);
+    frame[SBUS_FRAME_SIZE - 1] = 0x04;
+    TEST_ASSERT_TRUE(sbusFrameChannels(frame) == nullptr);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_bad_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,83 @@
+#include <unity.h>
+#include <seqlock.h>
+#include <atomic>
+#include <thread>
+
+void setUp() {}
+void tearDown() {}
+
+// Large enough that a copy is never a single store, every word holds the same count
+struct Sample
+{
+    uint32_t words[16];
+};
+
+static void test_single_thread()
+{
+    SeqLock<Sample> lock;
+    Sample in, out;
+    for (unsigned int i=0; i<16; ++i)
+        in.words[i] = i;
+    lock.write(in);
+    TEST_ASSERT_TRUE(lock.tryRead(out));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(in.words, out.words, 16);
+
+    // A reader never gets a value while a write is in progress
+    lock.beginWrite().words[0] = 100;
+    TEST_ASSERT_FALSE(lock.tryRead(out));
+    lock.endWrite();
+    TEST_ASSERT_TRUE(lock.tryRead(out));
+    TEST_ASSERT_EQUAL_UINT32(100, out.words[0]);
+}
+
+// One writer thread and one reader thread, the reader must never see a torn value
+static void test_two_threads()
+{
+    static SeqLock<Sample> lock;
+    static const uint32_t WRITES = 2000000;
+    std::atomic<bool> done(false);
+
+    std::thread writer([&done]() {
+        Sample s;
+        for (uint32_t cnt=1; cnt<=WRITES; ++cnt)
+        {
+            for (unsigned int i=0; i<16; ++i)
+                s.words[i] = cnt;
+            lock.write(s);
+        }
+        done = true;
+    });
+
+    uint32_t reads = 0;
+    uint32_t torn = 0;
+    uint32_t backwards = 0;
+    uint32_t last = 0;
+    while (!done)
+    {
+        Sample s;
+        lock.read(s);
+        ++reads;
+        for (unsigned int i=1; i<16; ++i)
+            if (s.words[i] != s.words[0])
+                ++torn;
+        if (s.words[0] < last)
+            ++backwards;
+        last = s.words[0];
+    }
+    writer.join();
+
+    Sample s;
+    lock.read(s);
+    TEST_ASSERT_EQUAL_UINT32(WRITES, s.words[0]);
+    TEST_ASSERT_GREATER_THAN(0, reads);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_UINT32(0, backwards);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_thread);
+    RUN_TEST(test_two_threads);
+    return UNITY_END();
+}